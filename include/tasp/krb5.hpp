@@ -5,13 +5,189 @@
 #ifndef TASP_KRB5_KRB5_HPP_
 #define TASP_KRB5_KRB5_HPP_
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace tasp::krb5
 {
 
 class ServiceImpl;
 
+/**
+ * @brief Гистограмма времени выполнения операции.
+ */
+struct Histogram
+{
+    /**
+     * @brief Верхние границы интервалов в наносекундах. Последний интервал
+     * гистограммы не ограничен сверху.
+     */
+    static constexpr std::array<std::uint64_t, 9> kBounds{100,
+                                                          1'000,
+                                                          10'000,
+                                                          100'000,
+                                                          1'000'000,
+                                                          10'000'000,
+                                                          100'000'000,
+                                                          1'000'000'000,
+                                                          10'000'000'000};
+
+    std::array<std::uint64_t, kBounds.size() + 1> buckets{}; /*!< Число значений в интервалах */
+    std::uint64_t count{0};                                  /*!< Общее число значений */
+    std::uint64_t sum_ns{0};                                 /*!< Сумма значений, нс */
+};
+
+/**
+ * @brief Число ошибок библиотеки Kerberos с одним кодом.
+ */
+struct ErrorCount
+{
+    std::int32_t code{0};   /*!< Код ошибки */
+    std::uint64_t count{0}; /*!< Число ошибок */
+};
+
+/**
+ * @brief Счетчики работы библиотеки.
+ *
+ * Счетчики общие для всех объектов Service процесса.
+ */
+struct ServiceMetrics
+{
+    static constexpr std::size_t kErrorCodes{16}; /*!< Число учитываемых кодов ошибок */
+
+    std::uint64_t create_calls{0};   /*!< Вызовы создания кеша */
+    std::uint64_t update_calls{0};   /*!< Вызовы обновления кеша */
+    std::uint64_t update_fast{0};    /*!< Обновления, завершенные без блокировки */
+    std::uint64_t update_backoff{0}; /*!< Обновления без обращения к KDC из-за задержки после ошибки */
+    std::uint64_t flight_waits{0};   /*!< Ожидания обновления другим потоком */
+    std::uint64_t service_hits{0};   /*!< Билеты сервисов, выданные из памяти */
+    std::uint64_t service_fetches{0}; /*!< Запросы билетов сервисов у KDC или кеша */
+    std::uint64_t s4u_hits{0};       /*!< Билеты от имени пользователей, выданные из памяти */
+    std::uint64_t s4u_fetches{0};    /*!< Запросы билетов S4U2Self и S4U2Proxy у KDC */
+    std::uint64_t s4u_misses{0};     /*!< Запросы билетов от имени пользователей, не найденных в памяти */
+    std::uint64_t s4u_evictions{0};  /*!< Вытеснения пользователей при превышении kerberos/s4u_cache или kerberos/s4u_cache_bytes */
+    std::uint64_t s4u_expired{0};    /*!< Удаления пользователей, все билеты которых истекли */
+    std::uint64_t s4u_entries{0};    /*!< Пользователи, билеты которых хранятся в памяти */
+    std::uint64_t s4u_bytes{0};      /*!< Память, занимаемая билетами пользователей, байт */
+    std::uint64_t shared_adopted{0}; /*!< Билеты, полученные ведущим процессом */
+    std::uint64_t shared_fallbacks{0}; /*!< Обновления у KDC вместо не обновившего билет ведущего процесса */
+    std::uint64_t gss_imports{0};    /*!< Создания учетных данных GSSAPI из кеша */
+    std::uint64_t gss_tokens{0};     /*!< Сформированные маркеры инициатора GSSAPI */
+    std::uint64_t renew_ok{0};       /*!< Успешные продления билета */
+    std::uint64_t renew_failed{0};   /*!< Ошибки продления билета */
+    std::uint64_t reinit_ok{0};      /*!< Успешные запросы нового билета */
+    std::uint64_t reinit_failed{0};  /*!< Ошибки запроса нового билета */
+
+    Histogram create_latency{}; /*!< Время создания кеша */
+    Histogram update_latency{}; /*!< Время обновления кеша с блокировкой */
+    Histogram kdc_latency{};    /*!< Время обмена с KDC */
+    Histogram lock_wait{};      /*!< Время ожидания блокировки кеша */
+    Histogram init_latency{};   /*!< Время создания контекста, таблицы ключей и кеша */
+
+    std::array<ErrorCount, kErrorCodes> errors{}; /*!< Ошибки по кодам */
+    std::uint64_t errors_other{0}; /*!< Ошибки с кодами, не вошедшими в errors */
+};
+
+/**
+ * @brief Состояние билета.
+ */
+enum class TicketState
+{
+    None,  /*!< Обновлять билет не требуется */
+    Renew, /*!< Необходимо продлить билет */
+    Reinit /*!< Необходимо запросить новый билет */
+};
+
+/**
+ * @brief Сведения о билете.
+ *
+ * Времена указаны в секундах unix-времени по локальным часам с учетом
+ * расхождения часов с KDC. Нулевые значения означают отсутствие билета.
+ */
+struct TicketInfo
+{
+    std::int64_t start_time{0};              /*!< Время начала действия */
+    std::int64_t end_time{0};                /*!< Время конца действия */
+    std::int64_t renew_till{0};              /*!< Время, до которого можно продлевать */
+    TicketState state{TicketState::Reinit};  /*!< Состояние билета */
+};
+
+/**
+ * @brief Источник начальных учетных данных объекта.
+ */
+enum class CredsSourceType
+{
+    Config, /*!< Тип из параметра kerberos/creds_source */
+    Keytab, /*!< Таблица ключей */
+    Pkinit, /*!< Сертификат клиента (PKINIT) */
+    Agent   /*!< Пароль от внешнего агента через локальный сокет */
+};
+
+/**
+ * @brief Категория ошибки получения билета.
+ */
+enum class ErrorCategory : std::int32_t
+{
+    None,      /*!< Ошибки нет */
+    Transient, /*!< Временная ошибка (KDC недоступен, ошибка ввода-вывода),
+                    повторный запрос может быть успешным */
+    Permanent, /*!< KDC отказал в выдаче билета, повторный запрос без
+                    изменения учетной записи не поможет */
+    Config     /*!< Ошибка настройки (krb5.conf, таблица ключей, имя кеша,
+                    расхождение часов) */
+};
+
+/**
+ * @brief Результат получения билета.
+ */
+struct Status
+{
+    std::int32_t code{0};                      /*!< Код ошибки Kerberos, 0 при успехе или ошибке без кода */
+    ErrorCategory category{ErrorCategory::None}; /*!< Категория ошибки */
+
+    /**
+     * @brief Проверка успешности.
+     *
+     * @return true, если ошибки нет
+     */
+    [[nodiscard]] constexpr bool Ok() const noexcept
+    {
+        return category == ErrorCategory::None;
+    }
+};
+
+/**
+ * @brief Состояние объекта аутентификации для проверок готовности.
+ */
+struct HealthInfo
+{
+    bool ready{false};                      /*!< Билет получен и его действие не закончилось */
+    TicketState state{TicketState::Reinit}; /*!< Состояние билета */
+    std::int64_t expires_in{0};             /*!< Время до конца действия билета, с, 0 при отсутствии билета */
+    Status last_status{};                   /*!< Результат последнего создания или обновления кеша */
+    bool backoff{false};                    /*!< Действует задержка повторных попыток после ошибки */
+    std::int64_t retry_in{0};               /*!< Время до следующей попытки обращения к KDC, с */
+    std::uint32_t failures{0};              /*!< Число ошибок обновления подряд */
+};
+
+/**
+ * @brief Маркер инициатора GSSAPI для сервиса.
+ */
+struct InitiatorToken
+{
+    std::string spn{};                  /*!< Имя сервиса */
+    std::vector<std::uint8_t> token{};  /*!< Маркер для передачи сервису */
+    std::uint32_t major{0};             /*!< Основной код GSSAPI, 0 при успехе */
+    std::uint32_t minor{0};             /*!< Код ошибки механизма Kerberos */
+};
+
 /**
  * @brief Интерфейс для работы с глобальным объектом аутентификации Kerberos.
  *
@@ -28,9 +204,72 @@ public:
      */
     static Service &Instance() noexcept;
 
+    /**
+     * @brief Запрос ссылки на объект аутентификации Kerberos для отдельного
+     * клиента.
+     *
+     * Для каждого клиента создается и хранится до завершения процесса свой
+     * объект с отдельными контекстом Kerberos, таблицей ключей, кешем
+     * учетных данных и блокировкой, поэтому клиенты обновляют билеты
+     * независимо друг от друга. Переменная окружения KRB5CCNAME указывает
+     * только на кеш объекта Instance(); имя кеша клиента возвращает
+     * CcacheName(). Источник учетных данных задается явно и не зависит от
+     * параметра kerberos/creds_source, действующего для Instance().
+     * Таблица ключей и источник задаются первым вызовом для клиента: при
+     * повторном вызове с другими значениями возвращается существующий
+     * объект и в журнал выводится ошибка. Имена клиента без области и с
+     * областью по умолчанию, а также с областью в другом регистре
+     * относятся к одному объекту.
+     *
+     * @param principal Уникальное имя клиента Kerberos (например,
+     * HTTP/host@REALM)
+     * @param keytab Путь к таблице ключей клиента (к сертификату или сокету
+     * агента для других источников) или пустая строка для пути по умолчанию
+     * @param source Источник учетных данных клиента
+     *
+     * @return Ссылка на объект аутентификации Kerberos клиента
+     */
+    static Service &ForPrincipal(
+        std::string_view principal,
+        std::string_view keytab = {},
+        CredsSourceType source = CredsSourceType::Keytab) noexcept;
+
+    /**
+     * @brief Запрос счетчиков работы библиотеки.
+     *
+     * Значения читаются без блокировок и могут быть несогласованы между собой
+     * на величину операций, выполняемых в момент чтения.
+     *
+     * @return Счетчики
+     */
+    [[nodiscard]] static ServiceMetrics Metrics() noexcept;
+
+    /**
+     * @brief Инициализация и получение билета.
+     *
+     * Создание контекста Kerberos (чтение krb5.conf), таблицы ключей и кеша
+     * учетных данных выполняется при первом обращении к объекту. Вызов при
+     * запуске программы переносит эту работу и первое обращение к KDC из
+     * обработки первого запроса.
+     *
+     * @return Результат получения билета
+     */
+    [[nodiscard]] bool Warmup() const noexcept;
+
+    /**
+     * @brief Инициализация и получение билета в фоновом потоке.
+     *
+     * @return Результат получения билета
+     */
+    [[nodiscard]] std::future<bool> WarmupAsync() const noexcept;
+
     /**
      * @brief Создание кеша учетных данных.
      *
+     * Новый билет запрашивается у KDC, даже если в это время выполняется
+     * обновление кеша; одновременные вызовы создания объединяются в один
+     * обмен с KDC.
+     *
      * @return Результат создания
      */
     [[nodiscard]] bool CreateCcache() const noexcept;
@@ -38,21 +277,211 @@ public:
     /**
      * @brief Обновление кеша учетных данных.
      *
+     * Пока не наступило время обновления ранее полученного билета, вызов не
+     * выполняет блокировок и обращений к кешу учетных данных. Билет
+     * обновляется заранее, до конца действия, по параметрам
+     * kerberos/renew_ahead, kerberos/reinit_ahead и kerberos/min_lifetime.
+     *
      * @return Результат обновления
      */
     [[nodiscard]] bool UpdateCcache() const noexcept;
 
+    /**
+     * @brief Создание кеша учетных данных с результатом в виде кода и
+     * категории ошибки.
+     *
+     * @return Результат создания
+     */
+    [[nodiscard]] Status CreateCcacheStatus() const noexcept;
+
+    /**
+     * @brief Обновление кеша учетных данных с результатом в виде кода и
+     * категории ошибки.
+     *
+     * Пока после ошибки действует задержка повторного обращения к KDC,
+     * возвращается результат последнего обновления.
+     *
+     * @return Результат обновления
+     */
+    [[nodiscard]] Status UpdateCcacheStatus() const noexcept;
+
+    /**
+     * @brief Запрос результата последнего создания или обновления кеша
+     * учетных данных, в том числе выполненного фоновым потоком.
+     *
+     * @return Результат последней операции
+     */
+    [[nodiscard]] Status LastStatus() const noexcept;
+
+    /**
+     * @brief Асинхронное создание кеша учетных данных.
+     *
+     * Обмен с KDC выполняется в потоке библиотеки, вызывающий поток не
+     * блокируется.
+     *
+     * @return Результат создания
+     */
+    [[nodiscard]] std::future<bool> CreateCcacheAsync() const noexcept;
+
+    /**
+     * @brief Асинхронное создание кеша учетных данных с вызовом функции по
+     * завершении.
+     *
+     * @param callback Функция, вызываемая в потоке библиотеки с результатом
+     * создания
+     */
+    void CreateCcacheAsync(std::function<void(bool)> callback) const noexcept;
+
+    /**
+     * @brief Асинхронное обновление кеша учетных данных.
+     *
+     * Если билет действителен, возвращается готовый результат без обращения
+     * к потоку библиотеки.
+     *
+     * @return Результат обновления
+     */
+    [[nodiscard]] std::future<bool> UpdateCcacheAsync() const noexcept;
+
+    /**
+     * @brief Асинхронное обновление кеша учетных данных с вызовом функции по
+     * завершении.
+     *
+     * @param callback Функция, вызываемая в потоке библиотеки с результатом
+     * обновления
+     */
+    void UpdateCcacheAsync(std::function<void(bool)> callback) const noexcept;
+
+    /**
+     * @brief Запрос имени кеша учетных данных.
+     *
+     * @return Имя кеша для использования в KRB5CCNAME или gss_krb5_ccache_name
+     */
+    [[nodiscard]] std::string CcacheName() const noexcept;
+
+    /**
+     * @brief Запрос сведений о текущем билете.
+     *
+     * Сведения читаются из опубликованного снимка без блокировок, выделения
+     * памяти и обращения к кешу учетных данных. Снимок обновляется при
+     * создании, обновлении и проверке кеша учетных данных.
+     *
+     * @return Сведения о билете
+     */
+    [[nodiscard]] TicketInfo Ticket() const noexcept;
+
+    /**
+     * @brief Запрос состояния для проверок готовности и работоспособности.
+     *
+     * Состояние собирается из опубликованного снимка билета, результата
+     * последнего обновления и задержки после ошибок без блокировок,
+     * обращений к KDC, кешу учетных данных и файлам, поэтому вызов
+     * выполняется за постоянное время и не создает контекст Kerberos. До
+     * первого получения билета объект не готов.
+     *
+     * @return Состояние объекта
+     */
+    [[nodiscard]] HealthInfo Health() const noexcept;
+
+    /**
+     * @brief Получение билета для сервиса.
+     *
+     * Действующий билет возвращается из памяти без обращения к кешу учетных
+     * данных. Отсутствующий или истекший билет запрашивается у KDC и
+     * сохраняется в кеше учетных данных. Билеты для сервисов из параметра
+     * kerberos/service_tickets и сервисов, запрошенных за последние
+     * kerberos/service_ticket_ttl, обновляются вместе с билетом на
+     * получение билетов; в памяти хранится не более
+     * kerberos/service_ticket_cache билетов.
+     *
+     * Возвращаются только сведения о билете, сам билет передается GSSAPI:
+     * учетные данные InitiatorTokens() создаются из билетов в памяти, и
+     * маркеры для этих сервисов формируются без просмотра кеша учетных
+     * данных и обращения к KDC. При вызове gss_init_sec_context с
+     * учетными данными по умолчанию билет находится просмотром кеша.
+     *
+     * @param spn Имя сервиса (например, HTTP/host.example.com@REALM)
+     *
+     * @return Сведения о билете сервиса, состояние Reinit при ошибке
+     */
+    [[nodiscard]] TicketInfo GetServiceTicket(std::string_view spn) const noexcept;
+
+    /**
+     * @brief Получение билета от имени пользователя (протокол S4U).
+     *
+     * Билет пользователя для клиента объекта запрашивается через S4U2Self,
+     * билет для сервиса — по нему через S4U2Proxy (ограниченное
+     * делегирование). Билеты не сохраняются в кеше учетных данных, а
+     * хранятся в памяти до конца своего действия; число пользователей
+     * ограничено параметром kerberos/s4u_cache, при его превышении
+     * вытесняются билеты пользователей, к которым дольше всего не
+     * обращались. Действующий билет возвращается без обращения к KDC.
+     *
+     * @param user Имя пользователя (например, user@REALM)
+     * @param spn Имя сервиса или пустая строка для билета S4U2Self
+     *
+     * @return Сведения о билете, состояние Reinit при ошибке
+     */
+    [[nodiscard]] TicketInfo ImpersonateTicket(std::string_view user,
+                                               std::string_view spn = {}) const noexcept;
+
+    /**
+     * @brief Формирование маркеров инициатора GSSAPI для нескольких сервисов.
+     *
+     * Маркеры формируются на одних учетных данных GSSAPI, созданных из
+     * билета на получение билетов и билетов для сервисов в памяти объекта
+     * (GetServiceTicket) и обновляемых вместе с ними, без gss_acquire_cred,
+     * чтения KRB5CCNAME и просмотра кеша учетных данных для каждого
+     * соединения.
+     * Маркеры формируются без взаимной аутентификации (например, для
+     * заголовка Negotiate HTTP), контексты GSSAPI после формирования
+     * маркера удаляются.
+     *
+     * @param spns Имена сервисов (например, HTTP/host.example.com@REALM)
+     *
+     * @return Маркеры в порядке имен сервисов
+     */
+    [[nodiscard]] std::vector<InitiatorToken> InitiatorTokens(
+        const std::vector<std::string> &spns) const noexcept;
+
+    /**
+     * @brief Запуск фонового упреждающего обновления кеша учетных данных.
+     *
+     * Билет обновляется в отдельном потоке по истечении доли времени его
+     * действия, заданной параметром kerberos/refresh_ratio (по умолчанию 0.8).
+     *
+     * @return Результат запуска
+     */
+    [[nodiscard]] bool StartRefresher() const noexcept;
+
+    /**
+     * @brief Остановка фонового обновления кеша учетных данных.
+     */
+    void StopRefresher() const noexcept;
+
     Service(const Service &) = delete;
     Service(Service &&) = delete;
     Service &operator=(const Service &) = delete;
     Service &operator=(Service &&) = delete;
 
 private:
+    friend struct std::default_delete<Service>;
+
     /**
      * @brief Конструктор.
      */
     Service() noexcept;
 
+    /**
+     * @brief Конструктор объекта для отдельного клиента.
+     *
+     * @param principal Уникальное имя клиента Kerberos
+     * @param keytab Путь к таблице ключей клиента
+     * @param source Источник учетных данных клиента
+     */
+    Service(std::string_view principal,
+            std::string_view keytab,
+            CredsSourceType source) noexcept;
+
     /**
      * @brief Деструктор.
      */
@@ -1,8 +1,20 @@
 #include "tasp/krb5.hpp"
 
 #include "krb5_impl.hpp"
+#include "krb5_metrics.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
 
 using std::make_unique;
+using std::string;
+using std::string_view;
+using std::unique_ptr;
 
 namespace tasp::krb5
 {
@@ -15,6 +27,86 @@ Service &Service::Instance() noexcept
     return instance;
 }
 
+//------------------------------------------------------------------------------
+Service &Service::ForPrincipal(string_view principal,
+                               string_view keytab,
+                               CredsSourceType source) noexcept
+{
+    if (principal.empty())
+    {
+        return Instance();
+    }
+
+    /**
+     * @brief Объект клиента и источник учетных данных, с которым он создан.
+     */
+    struct Registered
+    {
+        unique_ptr<Service> service;                  /*!< Объект аутентификации */
+        string keytab;                                /*!< Путь к таблице ключей */
+        CredsSourceType source{CredsSourceType::Keytab}; /*!< Источник учетных данных */
+    };
+
+    static std::mutex mutex;
+    static std::unordered_map<string, Registered> services;
+
+    // Одному клиенту соответствует один объект независимо от записи имени:
+    // без области, с областью по умолчанию или в другом регистре области.
+    const string name = CanonicalPrincipal(principal);
+    string key{name};
+    const auto realm = key.rfind('@');
+    if (realm != string::npos)
+    {
+        std::transform(key.begin() + static_cast<std::ptrdiff_t>(realm),
+                       key.end(),
+                       key.begin() + static_cast<std::ptrdiff_t>(realm),
+                       [](unsigned char letter) {
+                           return static_cast<char>(std::toupper(letter));
+                       });
+    }
+
+    const std::scoped_lock lock(mutex);
+
+    auto &registered = services[key];
+    if (registered.service == nullptr)
+    {
+        registered.service.reset(new Service(name, keytab, source));
+        registered.keytab = keytab;
+        registered.source = source;
+    }
+    else if (registered.keytab != keytab || registered.source != source)
+    {
+        Logging::Error(
+            "Объект клиента {} уже создан с таблицей ключей '{}' и источником "
+            "{}, таблица ключей '{}' и источник {} не используются",
+            principal,
+            registered.keytab,
+            static_cast<int>(registered.source),
+            keytab,
+            static_cast<int>(source));
+    }
+
+    return *registered.service;
+}
+
+//------------------------------------------------------------------------------
+ServiceMetrics Service::Metrics() noexcept
+{
+    return Counters::Instance().Load();
+}
+
+//------------------------------------------------------------------------------
+bool Service::Warmup() const noexcept
+{
+    return impl_->Warmup();
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> Service::WarmupAsync() const noexcept
+{
+    return impl_->WarmupAsync();
+}
+
 //------------------------------------------------------------------------------
 bool Service::CreateCcache() const noexcept
 {
@@ -27,9 +119,108 @@ bool Service::UpdateCcache() const noexcept
     return impl_->UpdateCcache();
 }
 
+//------------------------------------------------------------------------------
+Status Service::CreateCcacheStatus() const noexcept
+{
+    return impl_->CreateCcacheStatus();
+}
+
+//------------------------------------------------------------------------------
+Status Service::UpdateCcacheStatus() const noexcept
+{
+    return impl_->UpdateCcacheStatus();
+}
+
+//------------------------------------------------------------------------------
+Status Service::LastStatus() const noexcept
+{
+    return impl_->LastStatus();
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> Service::CreateCcacheAsync() const noexcept
+{
+    return impl_->CreateCcacheAsync();
+}
+
+//------------------------------------------------------------------------------
+void Service::CreateCcacheAsync(std::function<void(bool)> callback) const noexcept
+{
+    impl_->CreateCcacheAsync(std::move(callback));
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> Service::UpdateCcacheAsync() const noexcept
+{
+    return impl_->UpdateCcacheAsync();
+}
+
+//------------------------------------------------------------------------------
+void Service::UpdateCcacheAsync(std::function<void(bool)> callback) const noexcept
+{
+    impl_->UpdateCcacheAsync(std::move(callback));
+}
+
+//------------------------------------------------------------------------------
+string Service::CcacheName() const noexcept
+{
+    return impl_->CcacheName();
+}
+
+//------------------------------------------------------------------------------
+TicketInfo Service::Ticket() const noexcept
+{
+    return impl_->Ticket();
+}
+
+//------------------------------------------------------------------------------
+HealthInfo Service::Health() const noexcept
+{
+    return impl_->Health();
+}
+
+//------------------------------------------------------------------------------
+TicketInfo Service::GetServiceTicket(string_view spn) const noexcept
+{
+    return impl_->GetServiceTicket(spn);
+}
+
+//------------------------------------------------------------------------------
+TicketInfo Service::ImpersonateTicket(string_view user, string_view spn) const noexcept
+{
+    return impl_->ImpersonateTicket(user, spn);
+}
+
+//------------------------------------------------------------------------------
+std::vector<InitiatorToken> Service::InitiatorTokens(
+    const std::vector<std::string> &spns) const noexcept
+{
+    return impl_->InitiatorTokens(spns);
+}
+
+//------------------------------------------------------------------------------
+bool Service::StartRefresher() const noexcept
+{
+    return impl_->StartRefresher();
+}
+
+//------------------------------------------------------------------------------
+void Service::StopRefresher() const noexcept
+{
+    impl_->StopRefresher();
+}
+
 //------------------------------------------------------------------------------
 Service::Service() noexcept
-: impl_(make_unique<ServiceImpl>())
+: Service({}, {}, CredsSourceType::Config)
+{
+}
+
+//------------------------------------------------------------------------------
+Service::Service(string_view principal,
+                 string_view keytab,
+                 CredsSourceType source) noexcept
+: impl_(make_unique<ServiceImpl>(principal, keytab, source))
 {
 }
 
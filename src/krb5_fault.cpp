@@ -0,0 +1,78 @@
+#include "krb5_fault.hpp"
+
+#ifdef TASP_KRB5_FAULT_INJECTION
+
+#include "krb5_impl.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace tasp::krb5
+{
+
+/*------------------------------------------------------------------------------
+    FaultInjection
+------------------------------------------------------------------------------*/
+void FaultInjection::Install(krb5_context context) noexcept
+{
+    static FaultInjection instance;
+
+    if (instance.latency_ms_ <= 0 && instance.every_ <= 0)
+    {
+        return;
+    }
+
+    krb5_set_kdc_send_hook(context, &FaultInjection::PreSend, &instance);
+}
+
+//------------------------------------------------------------------------------
+FaultInjection::FaultInjection() noexcept
+: latency_ms_(ConfigInteger("kerberos/fault/latency", 0))
+, every_(ConfigInteger("kerberos/fault/every", 0))
+, error_(static_cast<krb5_error_code>(
+      ConfigInteger("kerberos/fault/error", KRB5_KDC_UNREACH)))
+{
+    if (latency_ms_ > 0 || every_ > 0)
+    {
+        Logging::Info(
+            "Включена имитация обмена с KDC: задержка {} мс, ошибка {} "
+            "при каждом {}-м обмене",
+            latency_ms_,
+            error_,
+            every_);
+    }
+}
+
+//------------------------------------------------------------------------------
+FaultInjection::~FaultInjection() noexcept = default;
+
+//------------------------------------------------------------------------------
+krb5_error_code FaultInjection::PreSend(krb5_context /*context*/,
+                                        void *data,
+                                        const krb5_data * /*realm*/,
+                                        const krb5_data * /*message*/,
+                                        krb5_data ** /*new_message_out*/,
+                                        krb5_data ** /*new_reply_out*/)
+{
+    auto *fault = static_cast<FaultInjection *>(data);
+
+    if (fault->latency_ms_ > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(fault->latency_ms_));
+    }
+
+    const auto exchange = ++fault->exchanges_;
+    if (fault->every_ > 0 &&
+        exchange % static_cast<unsigned long>(fault->every_) == 0)
+    {
+        return fault->error_;
+    }
+
+    return 0;
+}
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_FAULT_INJECTION
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * @brief Имитация задержек и ошибок обмена с KDC для тестирования.
+ *
+ * Компилируется только при включенном параметре сборки
+ * TASP_KRB5_FAULT_INJECTION.
+ */
+#ifndef TASP_KRB5_FAULT_HPP_
+#define TASP_KRB5_FAULT_HPP_
+
+#ifdef TASP_KRB5_FAULT_INJECTION
+
+#include <krb5.h>
+
+#include <atomic>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Обработчик обмена с KDC, имитирующий задержку ответа и ошибки.
+ *
+ * Параметры читаются из глобальной конфигурации:
+ * - kerberos/fault/latency — задержка каждого обмена, мс;
+ * - kerberos/fault/every — ошибка при каждом N-м обмене (0 — без ошибок);
+ * - kerberos/fault/error — код возвращаемой ошибки (по умолчанию
+ *   KRB5_KDC_UNREACH).
+ */
+class FaultInjection final
+{
+public:
+    /**
+     * @brief Установка обработчика для контекста Kerberos.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     */
+    static void Install(krb5_context context) noexcept;
+
+    FaultInjection(const FaultInjection &) = delete;
+    FaultInjection(FaultInjection &&) = delete;
+    FaultInjection &operator=(const FaultInjection &) = delete;
+    FaultInjection &operator=(FaultInjection &&) = delete;
+
+private:
+    /**
+     * @brief Конструктор. Читает параметры из конфигурации.
+     */
+    FaultInjection() noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~FaultInjection() noexcept;
+
+    /**
+     * @brief Обработчик перед отправкой запроса KDC.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     * @param data Объект FaultInjection
+     * @param realm Область запроса
+     * @param message Запрос
+     * @param new_message_out Замещающий запрос
+     * @param new_reply_out Замещающий ответ
+     *
+     * @return Код имитируемой ошибки или 0
+     */
+    static krb5_error_code PreSend(krb5_context context,
+                                   void *data,
+                                   const krb5_data *realm,
+                                   const krb5_data *message,
+                                   krb5_data **new_message_out,
+                                   krb5_data **new_reply_out);
+
+    /**
+     * @brief Задержка обмена, мс.
+     */
+    long latency_ms_{0};
+
+    /**
+     * @brief Периодичность ошибок.
+     */
+    long every_{0};
+
+    /**
+     * @brief Код имитируемой ошибки.
+     */
+    krb5_error_code error_{0};
+
+    /**
+     * @brief Число выполненных обменов.
+     */
+    std::atomic<unsigned long> exchanges_{0};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_FAULT_INJECTION
+
+#endif  // TASP_KRB5_FAULT_HPP_
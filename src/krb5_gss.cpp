@@ -0,0 +1,193 @@
+#include "krb5_gss.hpp"
+
+#include "tasp/logging.hpp"
+
+using std::shared_ptr;
+using std::string;
+
+namespace tasp::krb5
+{
+
+namespace
+{
+/**
+ * @brief Формирование текста сообщения GSSAPI по коду.
+ *
+ * @param code Код
+ * @param type Тип кода: GSS_C_GSS_CODE или GSS_C_MECH_CODE
+ *
+ * @return Текст сообщения
+ */
+string StatusText(OM_uint32 code, int type) noexcept
+{
+    string text;
+
+    OM_uint32 context{0};
+    do
+    {
+        OM_uint32 minor{0};
+        gss_buffer_desc buffer GSS_C_EMPTY_BUFFER;
+        if (GSS_ERROR(gss_display_status(&minor, code, type, GSS_C_NO_OID,
+                                         &context, &buffer)) != 0)
+        {
+            break;
+        }
+
+        if (!text.empty())
+        {
+            text += "; ";
+        }
+        text.append(static_cast<const char *>(buffer.value), buffer.length);
+        gss_release_buffer(&minor, &buffer);
+    } while (context != 0);
+
+    return text;
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+shared_ptr<GssCredential> GssCredential::Import(
+    krb5_principal principal,
+    const std::vector<const krb5_creds *> &creds) noexcept
+{
+    krb5_context context{nullptr};
+    auto error_code = krb5_init_context(&context);
+    if (error_code != 0)
+    {
+        Logging::Error("Ошибка создания контекста для учетных данных GSSAPI ({})",
+                       error_code);
+        return nullptr;
+    }
+
+    krb5_ccache ccache{nullptr};
+    error_code = krb5_cc_new_unique(context, "MEMORY", nullptr, &ccache);
+    if (error_code == 0)
+    {
+        error_code = krb5_cc_initialize(context, ccache, principal);
+    }
+
+    for (const auto *cred : creds)
+    {
+        if (error_code != 0)
+        {
+            break;
+        }
+
+        // Структура не изменяется, в кеш записывается ее копия.
+        error_code = krb5_cc_store_cred(context, ccache, const_cast<krb5_creds *>(cred));
+    }
+
+    if (error_code != 0)
+    {
+        const char *message = krb5_get_error_message(context, error_code);
+        Logging::Error("Ошибка записи билетов для учетных данных GSSAPI: {}", message);
+        krb5_free_error_message(context, message);
+
+        if (ccache != nullptr)
+        {
+            krb5_cc_destroy(context, ccache);
+        }
+        krb5_free_context(context);
+        return nullptr;
+    }
+
+    OM_uint32 minor{0};
+    gss_cred_id_t credential{GSS_C_NO_CREDENTIAL};
+
+    const OM_uint32 major = gss_krb5_import_cred(
+        &minor, ccache, principal, nullptr, &credential);
+    if (GSS_ERROR(major) != 0)
+    {
+        PrintError(major, minor, "gss_krb5_import_cred");
+        krb5_cc_destroy(context, ccache);
+        krb5_free_context(context);
+        return nullptr;
+    }
+
+    return shared_ptr<GssCredential>{new GssCredential(context, ccache, credential)};
+}
+
+//------------------------------------------------------------------------------
+GssCredential::GssCredential(krb5_context context,
+                             krb5_ccache ccache,
+                             gss_cred_id_t credential) noexcept
+: context_(context)
+, ccache_(ccache)
+, credential_(credential)
+{
+}
+
+//------------------------------------------------------------------------------
+GssCredential::~GssCredential() noexcept
+{
+    OM_uint32 minor{0};
+    gss_release_cred(&minor, &credential_);
+
+    krb5_cc_destroy(context_, ccache_);
+    krb5_free_context(context_);
+}
+
+//------------------------------------------------------------------------------
+InitiatorToken GssCredential::Token(const string &spn) const noexcept
+{
+    InitiatorToken result{};
+    result.spn = spn;
+
+    OM_uint32 minor{0};
+
+    gss_buffer_desc name_buffer{spn.size(), const_cast<char *>(spn.data())};
+    gss_name_t target{GSS_C_NO_NAME};
+    result.major = gss_import_name(&minor, &name_buffer, GSS_KRB5_NT_PRINCIPAL_NAME,
+                                   &target);
+    if (GSS_ERROR(result.major) != 0)
+    {
+        result.minor = minor;
+        PrintError(result.major, minor, "gss_import_name " + spn);
+        return result;
+    }
+
+    gss_ctx_id_t context{GSS_C_NO_CONTEXT};
+    gss_buffer_desc output GSS_C_EMPTY_BUFFER;
+    result.major = gss_init_sec_context(&minor,
+                                        credential_,
+                                        &context,
+                                        target,
+                                        gss_mech_krb5,
+                                        0,
+                                        GSS_C_INDEFINITE,
+                                        GSS_C_NO_CHANNEL_BINDINGS,
+                                        GSS_C_NO_BUFFER,
+                                        nullptr,
+                                        &output,
+                                        nullptr,
+                                        nullptr);
+    result.minor = minor;
+
+    if (GSS_ERROR(result.major) != 0)
+    {
+        PrintError(result.major, minor, "gss_init_sec_context " + spn);
+    }
+    else
+    {
+        const auto *data = static_cast<const std::uint8_t *>(output.value);
+        result.token.assign(data, data + output.length);
+    }
+
+    gss_release_buffer(&minor, &output);
+    gss_delete_sec_context(&minor, &context, GSS_C_NO_BUFFER);
+    gss_release_name(&minor, &target);
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+void GssCredential::PrintError(OM_uint32 major,
+                               OM_uint32 minor,
+                               const string &message) noexcept
+{
+    Logging::Error("Ошибка GSSAPI ({}): {} ({})", message,
+                   StatusText(major, GSS_C_GSS_CODE),
+                   StatusText(minor, GSS_C_MECH_CODE));
+}
+
+}  // namespace tasp::krb5
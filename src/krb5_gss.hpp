@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief Учетные данные GSSAPI на основе кеша учетных данных Kerberos.
+ */
+#ifndef TASP_KRB5_GSS_HPP_
+#define TASP_KRB5_GSS_HPP_
+
+#include "tasp/krb5.hpp"
+
+#include <gssapi/gssapi.h>
+#include <gssapi/gssapi_krb5.h>
+#include <krb5.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Учетные данные инициатора GSSAPI.
+ *
+ * Создаются с помощью gss_krb5_import_cred из отдельного кеша в памяти
+ * (MEMORY:), в который записываются билет на получение билетов и билеты
+ * для сервисов, хранящиеся в памяти объекта аутентификации. Маркеры для
+ * этих сервисов формируются без просмотра кеша учетных данных объекта и
+ * обращения к KDC. Объект используется для формирования маркеров
+ * несколькими потоками одновременно.
+ */
+class GssCredential final
+{
+public:
+    /**
+     * @brief Создание учетных данных из билетов.
+     *
+     * @param principal Уникальное имя клиента
+     * @param creds Билет на получение билетов и билеты для сервисов
+     *
+     * @return Учетные данные или nullptr при ошибке
+     */
+    static std::shared_ptr<GssCredential> Import(
+        krb5_principal principal,
+        const std::vector<const krb5_creds *> &creds) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~GssCredential() noexcept;
+
+    /**
+     * @brief Формирование маркера инициатора для сервиса.
+     *
+     * @param spn Имя сервиса
+     *
+     * @return Маркер
+     */
+    InitiatorToken Token(const std::string &spn) const noexcept;
+
+    GssCredential(const GssCredential &) = delete;
+    GssCredential(GssCredential &&) = delete;
+    GssCredential &operator=(const GssCredential &) = delete;
+    GssCredential &operator=(GssCredential &&) = delete;
+
+private:
+    /**
+     * @brief Конструктор.
+     *
+     * @param context Контекст, используемый только объектом
+     * @param ccache Кеш в памяти, из которого созданы учетные данные
+     * @param credential Учетные данные GSSAPI
+     */
+    GssCredential(krb5_context context,
+                  krb5_ccache ccache,
+                  gss_cred_id_t credential) noexcept;
+
+    /**
+     * @brief Ввод сообщения об ошибке GSSAPI в глобальный лог.
+     *
+     * @param major Основной код
+     * @param minor Код механизма
+     * @param message Сопровождающее сообщение
+     */
+    static void PrintError(OM_uint32 major,
+                           OM_uint32 minor,
+                           const std::string &message) noexcept;
+
+    /**
+     * Контекст для удаления кеша в памяти. Объект может быть разрушен в
+     * любом потоке, поэтому основной контекст не используется.
+     */
+    krb5_context context_{nullptr};
+
+    /**
+     * Кеш в памяти. Учетные данные GSSAPI ссылаются на него и сохраняют в
+     * нем билеты, полученные при формировании маркеров.
+     */
+    krb5_ccache ccache_{nullptr};
+
+    /**
+     * Учетные данные GSSAPI.
+     */
+    gss_cred_id_t credential_{GSS_C_NO_CREDENTIAL};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_GSS_HPP_
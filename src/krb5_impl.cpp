@@ -1,8 +1,27 @@
 #include "krb5_impl.hpp"
 
+#include "krb5_fault.hpp"
+#include "krb5_metrics.hpp"
+#include "krb5_pool.hpp"
+#include "krb5_source.hpp"
+
 #include "tasp/config.hpp"
 #include "tasp/logging.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+#include <system_error>
+#include <utility>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using std::array;
 using std::make_shared;
@@ -19,6 +38,245 @@ using CMC::logGlobal;
 namespace tasp::krb5
 {
 
+namespace
+{
+/**
+ * @brief Минимальный интервал между фоновыми обновлениями.
+ */
+constexpr std::chrono::seconds kRefreshMinInterval{1};
+
+/**
+ * @brief Последняя ошибка библиотеки Kerberos, переданная в PrintError()
+ * текущим потоком.
+ */
+thread_local krb5_error_code last_error{0};
+
+/**
+ * @brief Объекты ServiceImpl процесса для обработки fork().
+ */
+struct ForkRegistry
+{
+    std::mutex mutex{};                    /*!< Блокировка списка */
+    std::vector<ServiceImpl *> services{};  /*!< Объекты */
+};
+
+/**
+ * @brief Запрос списка объектов для обработки fork().
+ *
+ * @return Ссылка на список
+ */
+ForkRegistry &Forks() noexcept
+{
+    static ForkRegistry registry;
+    return registry;
+}
+
+/**
+ * @brief Обработчик pthread_atfork перед fork().
+ */
+void PrepareFork() noexcept
+{
+    auto &registry = Forks();
+    registry.mutex.lock();
+    for (auto *service : registry.services)
+    {
+        service->ForkPrepare();
+    }
+    ContextPool::Instance().ForkPrepare();
+}
+
+/**
+ * @brief Обработчик pthread_atfork в родительском процессе.
+ */
+void ParentAfterFork() noexcept
+{
+    auto &registry = Forks();
+    ContextPool::Instance().ForkParent();
+    for (auto service = registry.services.rbegin();
+         service != registry.services.rend();
+         ++service)
+    {
+        (*service)->ForkParent();
+    }
+    registry.mutex.unlock();
+}
+
+/**
+ * @brief Обработчик pthread_atfork в дочернем процессе.
+ */
+void ChildAfterFork() noexcept
+{
+    auto &registry = Forks();
+    ContextPool::Instance().ForkChild();
+    for (auto service = registry.services.rbegin();
+         service != registry.services.rend();
+         ++service)
+    {
+        (*service)->ForkChild();
+    }
+    registry.mutex.unlock();
+}
+
+/**
+ * @brief Формирование из имени клиента части имени файла кеша.
+ *
+ * @param principal Уникальное имя клиента Kerberos
+ *
+ * @return Имя клиента, в котором недопустимые символы заменены на '_'
+ */
+string Identity(string_view principal) noexcept
+{
+    string identity{principal};
+    std::replace_if(
+        identity.begin(),
+        identity.end(),
+        [](char symbol) {
+            return std::isalnum(static_cast<unsigned char>(symbol)) == 0 &&
+                   symbol != '.' && symbol != '-';
+        },
+        '_');
+
+    return identity;
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+long ConfigInteger(string_view key, long default_value) noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    const string name{key};
+    const string text = cfg.variable(name, "");
+    if (text.empty())
+    {
+        return default_value;
+    }
+
+    try
+    {
+        return std::stol(text);
+    }
+    catch (const std::exception &error)
+    {
+        Logging::Error("Ошибка чтения параметра {}: {} ({})", name, text, error.what());
+    }
+
+    return default_value;
+}
+
+//------------------------------------------------------------------------------
+double ConfigDouble(string_view key, double default_value) noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    const string name{key};
+    const string text = cfg.variable(name, "");
+    if (text.empty())
+    {
+        return default_value;
+    }
+
+    try
+    {
+        return std::stod(text);
+    }
+    catch (const std::exception &error)
+    {
+        Logging::Error("Ошибка чтения параметра {}: {} ({})", name, text, error.what());
+    }
+
+    return default_value;
+}
+
+//------------------------------------------------------------------------------
+std::vector<string> ConfigList(string_view key) noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    const string text = cfg.variable(string{key}, "");
+
+    std::vector<string> list;
+    string item;
+    for (const char symbol : text)
+    {
+        if (symbol == ',' || std::isspace(static_cast<unsigned char>(symbol)) != 0)
+        {
+            if (!item.empty())
+            {
+                list.push_back(std::move(item));
+                item.clear();
+            }
+            continue;
+        }
+        item.push_back(symbol);
+    }
+
+    if (!item.empty())
+    {
+        list.push_back(std::move(item));
+    }
+
+    return list;
+}
+
+//------------------------------------------------------------------------------
+string CanonicalPrincipal(string_view name) noexcept
+{
+    const string text{name};
+
+    const auto lease = ContextPool::Instance().Checkout();
+    krb5_context context = lease.Get();
+    if (context == nullptr)
+    {
+        return text;
+    }
+
+    krb5_principal principal{nullptr};
+    if (krb5_parse_name(context, text.c_str(), &principal) != 0)
+    {
+        return text;
+    }
+
+    char *unparsed{nullptr};
+    string canonical{text};
+    if (krb5_unparse_name(context, principal, &unparsed) == 0)
+    {
+        canonical = unparsed;
+        krb5_free_unparsed_name(context, unparsed);
+    }
+    krb5_free_principal(context, principal);
+
+    return canonical;
+}
+
+//------------------------------------------------------------------------------
+void AbandonThread(std::thread &thread) noexcept
+{
+    if (!thread.joinable())
+    {
+        return;
+    }
+
+    try
+    {
+        thread.detach();
+    }
+    catch (const std::system_error &error)
+    {
+        // Подключаемый объект потока нельзя разрушить, поэтому он переносится
+        // в память, которая не освобождается.
+        Logging::Error("Ошибка отсоединения потока ({})", error.what());
+        static_cast<void>(new std::thread(std::move(thread)));
+    }
+}
+
+//------------------------------------------------------------------------------
+void InitCredsOptDeleter::operator()(
+    krb5_get_init_creds_opt *options) const noexcept
+{
+    krb5_get_init_creds_opt_free(context, options);
+}
+
 /*------------------------------------------------------------------------------
     Context
 ------------------------------------------------------------------------------*/
@@ -45,38 +303,173 @@ shared_ptr<_krb5_context> Context::GetContextPtr() const noexcept
 //------------------------------------------------------------------------------
 void Context::PrintError(krb5_error_code code, string_view message) const noexcept
 {
-    const char *krb5_message = krb5_get_error_message(context(), code);
+    PrintError(GetContext(), code, message);
+}
+
+//------------------------------------------------------------------------------
+void Context::PrintError(krb5_context context,
+                         krb5_error_code code,
+                         string_view message) noexcept
+{
+    static const std::chrono::nanoseconds interval{std::chrono::seconds{
+        std::max(ConfigInteger("kerberos/error_log_interval", 60), 0L)}};
+
+    last_error = code;
+
+    std::uint64_t suppressed{0};
+    if (!Counters::Instance().AddError(code, interval, suppressed))
+    {
+        return;
+    }
+
+    const char *krb5_message = krb5_get_error_message(context, code);
+
+    if (suppressed == 0)
+    {
+        Logging::Error("Ошибка Kerberos ({}): {}", message, krb5_message);
+    }
+    else
+    {
+        Logging::Error("Ошибка Kerberos ({}): {} (повторов после прошлой записи: {})",
+                       message,
+                       krb5_message,
+                       suppressed);
+    }
+
+    krb5_free_error_message(context, krb5_message);
+}
+
+//------------------------------------------------------------------------------
+ErrorCategory Context::Category(krb5_error_code code) noexcept
+{
+    switch (code)
+    {
+        case KRB5_KDC_UNREACH:
+        case KRB5KDC_ERR_SVC_UNAVAILABLE:
+        case KRB5KRB_ERR_RESPONSE_TOO_BIG:
+        case KRB5_REALM_CANT_RESOLVE:
+        case KRB5_CC_IO:
+        case KRB5_CC_NOMEM:
+        case ENOMEM:
+        case EAGAIN:
+        case ETIMEDOUT:
+        case ECONNREFUSED:
+        case EINTR:
+            return ErrorCategory::Transient;
+
+        case KRB5_CONFIG_BADFORMAT:
+        case KRB5_CONFIG_CANTOPEN:
+        case KRB5_CONFIG_NODEFREALM:
+        case KRB5_REALM_UNKNOWN:
+        case KRB5_KT_NOTFOUND:
+        case KRB5_KT_KVNONOTFOUND:
+        case KRB5_KT_BADNAME:
+        case KRB5_KT_UNKNOWN_TYPE:
+        case KRB5_CC_BADNAME:
+        case KRB5_CC_UNKNOWN_TYPE:
+        case KRB5_FCC_PERM:
+        case KRB5_PARSE_MALFORMED:
+        case KRB5KDC_ERR_PREAUTH_FAILED:
+        case KRB5KRB_AP_ERR_BAD_INTEGRITY:
+        case KRB5KRB_AP_ERR_SKEW:
+        case KRB5_KDCREP_SKEW:
+        case ENOENT:
+        case EACCES:
+            return ErrorCategory::Config;
+
+        default:
+            return ErrorCategory::Permanent;
+    }
+}
+
+//------------------------------------------------------------------------------
+void Context::ResetLastError() noexcept
+{
+    last_error = 0;
+}
 
-    Logging::Error("Ошибка Kerberos ({}): {}", message, krb5_message);
+//------------------------------------------------------------------------------
+Status Context::MakeStatus(bool res) noexcept
+{
+    if (res)
+    {
+        return Status{};
+    }
 
-    krb5_free_error_message(context(), krb5_message);
+    // Ошибка без кода библиотеки (например, клиент не найден в таблице
+    // ключей) не исправится повторным запросом.
+    return Status{last_error,
+                  last_error != 0 ? Category(last_error) : ErrorCategory::Permanent};
 }
 
 /*------------------------------------------------------------------------------
     Principal
 ------------------------------------------------------------------------------*/
-Principal::Principal(const shared_ptr<_krb5_context> &context,
-                             krb5_const_principal principal) noexcept
-: Context(context)
+Principal::Principal(krb5_context context, krb5_const_principal principal) noexcept
+: context_(context)
 {
-    auto error_code =
-        krb5_copy_principal(Context::GetContext(), principal, &principal_);
+    auto error_code = krb5_copy_principal(context_, principal, &principal_);
     if (error_code != 0)
     {
-        printError(error_code, "krb5_copy_principal");
+        Context::PrintError(context_, error_code, "krb5_copy_principal");
+        principal_ = nullptr;
+    }
+}
+
+//------------------------------------------------------------------------------
+Principal::~Principal() noexcept
+{
+    Reset();
+}
+
+//------------------------------------------------------------------------------
+Principal::Principal(Principal &&other) noexcept
+: context_(other.context_)
+, principal_(other.principal_)
+{
+    other.principal_ = nullptr;
+}
+
+//------------------------------------------------------------------------------
+Principal &Principal::operator=(Principal &&other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        context_ = other.context_;
+        principal_ = other.principal_;
+        other.principal_ = nullptr;
     }
+
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+Principal Principal::Adopt(krb5_context context, krb5_principal principal) noexcept
+{
+    Principal result{};
+    result.context_ = context;
+    result.principal_ = principal;
+
+    return result;
 }
 
 //------------------------------------------------------------------------------
-Principal::~Principal()
+Principal Principal::Clone() const noexcept
 {
-    krb5_free_principal(context(), principal_);
+    return Empty() ? Principal{} : Principal{context_, principal_};
+}
+
+//------------------------------------------------------------------------------
+bool Principal::Empty() const noexcept
+{
+    return principal_ == nullptr;
 }
 
 //------------------------------------------------------------------------------
 string_view Principal::Realm() const noexcept
 {
-    return principal_->realm.data;
+    return {principal_->realm.data, principal_->realm.length};
 }
 
 //------------------------------------------------------------------------------
@@ -85,35 +478,94 @@ krb5_principal Principal::Ptr() const noexcept
     return principal_;
 }
 
+//------------------------------------------------------------------------------
+void Principal::Reset() noexcept
+{
+    if (principal_ != nullptr)
+    {
+        krb5_free_principal(context_, principal_);
+        principal_ = nullptr;
+    }
+}
+
 /*------------------------------------------------------------------------------
     Creds
 ------------------------------------------------------------------------------*/
-Creds::Creds(const shared_ptr<_krb5_context> &context,
-                     krb5_creds creds) noexcept
-: Context(context)
+Creds::Creds(krb5_context context, krb5_creds creds) noexcept
+: context_(context)
+, creds_(creds)
+{
+    krb5_timestamp now{0};
+    krb5_timeofday(context_, &now);
+    offset_ = static_cast<std::time_t>(now) - std::time(nullptr);
+}
+
+//------------------------------------------------------------------------------
+Creds::Creds(krb5_context context, krb5_creds creds, std::time_t offset) noexcept
+: context_(context)
 , creds_(creds)
+, offset_(offset)
 {
 }
 
 //------------------------------------------------------------------------------
 Creds::~Creds() noexcept
 {
-    krb5_free_cred_contents(context(), &creds_);
+    Reset();
 }
 
 //------------------------------------------------------------------------------
-Creds::State Creds::State() const noexcept
+Creds::Creds(Creds &&other) noexcept
+: context_(other.context_)
+, creds_(other.creds_)
+, offset_(other.offset_)
 {
-    State result{State::None};
+    other.creds_ = krb5_creds{};
+}
 
-    krb5_timestamp now{0};
-    krb5_timeofday(GetContext(), &now);
-    if (now >= EndTime())
+//------------------------------------------------------------------------------
+Creds &Creds::operator=(Creds &&other) noexcept
+{
+    if (this != &other)
     {
-        result = now >= RenewTime() ? State::Reinit : State::Renew;
+        Reset();
+        context_ = other.context_;
+        creds_ = other.creds_;
+        offset_ = other.offset_;
+        other.creds_ = krb5_creds{};
     }
 
-    return result;
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+bool Creds::Empty() const noexcept
+{
+    return creds_.client == nullptr;
+}
+
+//------------------------------------------------------------------------------
+void Creds::Reset() noexcept
+{
+    if (context_ != nullptr)
+    {
+        krb5_free_cred_contents(context_, &creds_);
+    }
+    creds_ = krb5_creds{};
+}
+
+//------------------------------------------------------------------------------
+enum Creds::State Creds::State() const noexcept
+{
+    switch (Info().state)
+    {
+        case TicketState::Renew:
+            return State::Renew;
+        case TicketState::Reinit:
+            return State::Reinit;
+        default:
+            return State::None;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -134,16 +586,95 @@ krb5_timestamp Creds::RenewTime() const noexcept
     return creds_.times.renew_till;
 }
 
+//------------------------------------------------------------------------------
+krb5_timestamp Creds::RefreshTime(double ratio) const noexcept
+{
+    const auto lifetime = static_cast<double>(EndTime() - StartTime());
+
+    return StartTime() + static_cast<krb5_timestamp>(lifetime * ratio);
+}
+
+//------------------------------------------------------------------------------
+std::time_t Creds::LocalTime(krb5_timestamp timestamp) const noexcept
+{
+    if (timestamp == 0)
+    {
+        return 0;
+    }
+
+    return static_cast<std::time_t>(timestamp) - offset_;
+}
+
+//------------------------------------------------------------------------------
+std::size_t Creds::Size() const noexcept
+{
+    const auto principal_size = [](krb5_const_principal principal) -> std::size_t {
+        if (principal == nullptr)
+        {
+            return 0;
+        }
+
+        auto size = sizeof(krb5_principal_data) + principal->realm.length;
+        for (krb5_int32 index = 0; index < principal->length; ++index)
+        {
+            size += sizeof(krb5_data) + principal->data[index].length;
+        }
+
+        return size;
+    };
+
+    std::size_t size = sizeof(Creds) + principal_size(creds_.client) +
+                       principal_size(creds_.server) + creds_.keyblock.length +
+                       creds_.ticket.length + creds_.second_ticket.length;
+
+    for (auto **address = creds_.addresses; address != nullptr && *address != nullptr;
+         ++address)
+    {
+        size += sizeof(krb5_address) + (*address)->length;
+    }
+
+    for (auto **authdata = creds_.authdata; authdata != nullptr && *authdata != nullptr;
+         ++authdata)
+    {
+        size += sizeof(krb5_authdata) + (*authdata)->length;
+    }
+
+    return size;
+}
+
+//------------------------------------------------------------------------------
+TicketInfo Creds::Info() const noexcept
+{
+    TicketInfo info{};
+    info.start_time = LocalTime(StartTime());
+    info.end_time = LocalTime(EndTime());
+    info.renew_till = LocalTime(RenewTime());
+    info.state = RefreshPolicy::Instance().Decide(info, std::time(nullptr));
+
+    return info;
+}
+
+//------------------------------------------------------------------------------
+bool Creds::RefreshDue(double ratio) const noexcept
+{
+    return Now() >= RefreshTime(ratio);
+}
+
+//------------------------------------------------------------------------------
+krb5_timestamp Creds::Now() const noexcept
+{
+    return static_cast<krb5_timestamp>(std::time(nullptr) + offset_);
+}
+
 //------------------------------------------------------------------------------
 string Creds::TimesInfo() const noexcept
 {
-    krb5_timestamp now{0};
-    krb5_timeofday(GetContext(), &now);
+    const krb5_timestamp now{Now()};
 
     string text{};
     text.append("now: ").append(TimeToString(now)).append("\n");
     text.append("start time: ").append(TimeToString(StartTime())).append("\n");
-    text.append("end time: ").append(TimeToString(SndTime())).append("\n");
+    text.append("end time: ").append(TimeToString(EndTime())).append("\n");
     text.append("renew possible until: ").append(TimeToString(RenewTime()));
 
     return text;
@@ -164,6 +695,12 @@ krb5_creds *Creds::Ptr() noexcept
     return &creds_;
 }
 
+//------------------------------------------------------------------------------
+const krb5_creds *Creds::Ptr() const noexcept
+{
+    return &creds_;
+}
+
 /*------------------------------------------------------------------------------
     FileInterface
 ------------------------------------------------------------------------------*/
@@ -180,43 +717,123 @@ FileInterface::~FileInterface() noexcept = default;
 //------------------------------------------------------------------------------
 bool FileInterface::FileExists() const noexcept
 {
+    if (stamp_valid_ && watched_.load(std::memory_order_acquire) &&
+        !changed_.load(std::memory_order_acquire))
+    {
+        return stamp_.exists;
+    }
+
     bool res{false};
-    string buf{fullpath_};
+    const string_view path{FilePath()};
 
     try
     {
-        const string prefix{"FILE:"};
-        if (buf.rfind(prefix, 0) == 0)
-        {
-            buf.erase(0, prefix.length());
-        }
-
-        res = fs::exists(buf);
+        res = fs::exists(fs::path{path.begin(), path.end()});
     }
     catch (const fs::filesystem_error &fs_error)
     {
         Logging::Error(
-            "Ошибка доступа к файлу: {} ({})", buf, fs_error.what());
+            "Ошибка доступа к файлу: {} ({})", path, fs_error.what());
     }
 
     return res;
 }
 
+//------------------------------------------------------------------------------
+bool FileInterface::FileChanged() const noexcept
+{
+    if (stamp_valid_ && watched_.load(std::memory_order_acquire) &&
+        !changed_.exchange(false, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+
+    return Restamp();
+}
+
+//------------------------------------------------------------------------------
+bool FileInterface::Watch(FileWatcher &watcher,
+                          std::function<void()> callback) noexcept
+{
+    return watcher.Watch(FilePath(), &changed_, &watched_, std::move(callback));
+}
+
+//------------------------------------------------------------------------------
+bool FileInterface::FileMatchesStamp() const noexcept
+{
+    return SameStamp(ReadStamp());
+}
+
+//------------------------------------------------------------------------------
+bool FileInterface::Restamp() const noexcept
+{
+    const auto stamp = ReadStamp();
+    const bool changed = !SameStamp(stamp);
+
+    stamp_ = stamp;
+    stamp_valid_ = true;
+
+    return changed;
+}
+
+//------------------------------------------------------------------------------
+FileInterface::FileStamp FileInterface::ReadStamp() const noexcept
+{
+    FileStamp stamp{};
+
+    const string path{FilePath()};
+    struct stat info{};
+    if (stat(path.c_str(), &info) == 0)
+    {
+        stamp.exists = true;
+        stamp.device = info.st_dev;
+        stamp.inode = info.st_ino;
+        stamp.size = info.st_size;
+        stamp.mtime_sec = info.st_mtim.tv_sec;
+        stamp.mtime_nsec = info.st_mtim.tv_nsec;
+    }
+
+    return stamp;
+}
+
+//------------------------------------------------------------------------------
+bool FileInterface::SameStamp(const FileStamp &stamp) const noexcept
+{
+    return stamp_valid_ && stamp.exists == stamp_.exists &&
+           stamp.device == stamp_.device && stamp.inode == stamp_.inode &&
+           stamp.size == stamp_.size && stamp.mtime_sec == stamp_.mtime_sec &&
+           stamp.mtime_nsec == stamp_.mtime_nsec;
+}
+
 //------------------------------------------------------------------------------
 const char *FileInterface::FileName() const noexcept
 {
     return fullpath_.data();
 }
 
+//------------------------------------------------------------------------------
+string_view FileInterface::FilePath() const noexcept
+{
+    constexpr string_view prefix{"FILE:"};
+
+    string_view path{fullpath_};
+    if (path.substr(0, prefix.length()) == prefix)
+    {
+        path.remove_prefix(prefix.length());
+    }
+
+    return path;
+}
+
 //------------------------------------------------------------------------------
 void FileInterface::Init() noexcept
 {
     auto &cfg = configGlobal::instance();
-    _program_type = cfg.variable("system/type", "manual");
+    program_type_ = cfg.variable("system/type", "manual");
 
-    if (_fullpath.empty())
+    if (fullpath_.empty())
     {
-        _fullpath = _program_type == "manual" ? defaultName() : configName();
+        fullpath_ = program_type_ == "manual" ? DefaultName() : ConfigName();
     }
 }
 
@@ -226,12 +843,127 @@ std::string_view FileInterface::ProgramType() const noexcept
     return program_type_;
 }
 
+/*------------------------------------------------------------------------------
+    CredsSource
+------------------------------------------------------------------------------*/
+CredsSource::CredsSource(const shared_ptr<_krb5_context> &context,
+                         string_view fullpath,
+                         string_view principal) noexcept
+: FileInterface(context, fullpath)
+, ticket_lifetime_(
+      static_cast<krb5_deltat>(ConfigInteger("kerberos/ticket_lifetime", 0)))
+, renew_lifetime_(
+      static_cast<krb5_deltat>(ConfigInteger("kerberos/renew_lifetime", 0)))
+{
+    string name{principal};
+    if (name.empty())
+    {
+        name = configGlobal::instance().variable("kerberos/principal", "");
+    }
+
+    if (!name.empty())
+    {
+        krb5_principal parsed{nullptr};
+        const auto error_code = krb5_parse_name(GetContext(), name.c_str(), &parsed);
+        if (error_code == 0)
+        {
+            principal_ = Principal::Adopt(GetContext(), parsed);
+        }
+        else
+        {
+            PrintError(error_code, "krb5_parse_name");
+            Logging::Error("Недопустимое имя клиента {}", name);
+            principal_invalid_ = true;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+CredsSource::~CredsSource() noexcept = default;
+
+//------------------------------------------------------------------------------
+shared_ptr<Creds> CredsSource::GetCreds() const noexcept
+{
+    const auto *principal = GetPrincipal();
+    if (principal == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto creds = GetCreds(*principal);
+    return creds.Empty() ? nullptr : make_shared<Creds>(std::move(creds));
+}
+
+//------------------------------------------------------------------------------
+const Principal *CredsSource::GetPrincipal() const noexcept
+{
+    if (principal_invalid_)
+    {
+        Logging::Error("Задано недопустимое имя клиента для учетных данных {}",
+                       FileName());
+        return nullptr;
+    }
+
+    if (principal_.Empty())
+    {
+        Logging::Error("Не задано имя клиента для учетных данных {}", FileName());
+        return nullptr;
+    }
+
+    return &principal_;
+}
+
+//------------------------------------------------------------------------------
+InitCredsOpt CredsSource::InitCredsOptions(bool required) const noexcept
+{
+    InitCredsOpt options{nullptr, InitCredsOptDeleter{GetContext()}};
+
+    if (!required && ticket_lifetime_ <= 0 && renew_lifetime_ <= 0)
+    {
+        return options;
+    }
+
+    krb5_get_init_creds_opt *opt{nullptr};
+    auto error_code = krb5_get_init_creds_opt_alloc(GetContext(), &opt);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_get_init_creds_opt_alloc");
+        return options;
+    }
+    options.reset(opt);
+
+    if (ticket_lifetime_ > 0)
+    {
+        krb5_get_init_creds_opt_set_tkt_life(opt, ticket_lifetime_);
+    }
+
+    if (renew_lifetime_ > 0)
+    {
+        krb5_get_init_creds_opt_set_renew_life(opt, renew_lifetime_);
+    }
+
+    return options;
+}
+
+//------------------------------------------------------------------------------
+const Principal &CredsSource::ConfiguredPrincipal() const noexcept
+{
+    return principal_;
+}
+
+//------------------------------------------------------------------------------
+bool CredsSource::PrincipalInvalid() const noexcept
+{
+    return principal_invalid_;
+}
+
 /*------------------------------------------------------------------------------
     Keytab
 ------------------------------------------------------------------------------*/
 Keytab::Keytab(const shared_ptr<_krb5_context> &context,
-                       string_view fullpath) noexcept
-: FileInterface(context, fullpath)
+                       string_view fullpath,
+                       string_view principal) noexcept
+: CredsSource(context, fullpath, principal)
 {
     FileInterface::Init();
 
@@ -245,6 +977,8 @@ Keytab::Keytab(const shared_ptr<_krb5_context> &context,
 //------------------------------------------------------------------------------
 Keytab::~Keytab() noexcept
 {
+    CloseMemory();
+
     auto error_code = krb5_kt_close(GetContext(), keytab_);
     if (error_code != 0)
     {
@@ -253,44 +987,121 @@ Keytab::~Keytab() noexcept
 }
 
 //------------------------------------------------------------------------------
-shared_ptr<Creds> Keytab::GetCreds() const noexcept
+Creds Keytab::GetCreds(const Principal &principal) const noexcept
 {
-    shared_ptr<Creds> creds_ptr{nullptr};
+    krb5_creds creds{};
 
-    auto principal = GetPrincipal();
-    if (principal != nullptr)
+    auto *keytab = memory_keytab_ != nullptr ? memory_keytab_ : keytab_;
+    const auto options = InitCredsOptions();
+    krb5_error_code error_code{0};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_init_creds_keytab(GetContext(),
+                                                &creds,
+                                                principal.Ptr(),
+                                                keytab,
+                                                0,
+                                                nullptr,
+                                                options.get());
+    }
+    if (error_code != 0)
     {
-        krb5_creds creds;
+        PrintError(error_code, "krb5_get_init_creds_keytab");
+        return Creds{};
+    }
 
-        auto error_code = krb5_get_init_creds_keytab(
-            GetContext(), &creds, principal->ptr(), keytab_, 0, nullptr, nullptr);
-        if (error_code != 0)
-        {
-            PrintError(error_code, "krb5_get_init_creds_keytab");
-        }
+    return Creds{GetContext(), creds};
+}
+
+//------------------------------------------------------------------------------
+const Principal *Keytab::GetPrincipal() const noexcept
+{
+    if (FileChanged())
+    {
+        Load();
+    }
 
-        creds_ptr = make_shared<Creds>(GetContextPtr(), creds);
+    // Первый клиент таблицы ключей используется, только если имя клиента
+    // не задано, а не если заданное имя не удалось разобрать.
+    if (PrincipalInvalid())
+    {
+        return CredsSource::GetPrincipal();
     }
 
-    return creds_ptr;
+    const auto &principal = ConfiguredPrincipal();
+    if (principal.Empty())
+    {
+        return entries_.empty() ? nullptr : &entries_.front().principal;
+    }
+
+    const auto entry = std::find_if(
+        entries_.begin(), entries_.end(), [this, &principal](const Entry &item) {
+            return krb5_principal_compare(
+                       GetContext(), item.principal.Ptr(), principal.Ptr()) != 0;
+        });
+    if (entry == entries_.end())
+    {
+        Logging::Error("Клиент не найден в таблице ключей {}", FileName());
+        return nullptr;
+    }
+
+    return &entry->principal;
 }
 
 //------------------------------------------------------------------------------
-shared_ptr<Principal> Keytab::GetPrincipal() const noexcept
+void Keytab::Load() const noexcept
 {
-    shared_ptr<Principal> principal{nullptr};
+    static std::atomic<unsigned int> counter{0};
+
+    entries_.clear();
+    CloseMemory();
+
+    const string memory_name =
+        "MEMORY:tasp_krb5_keytab_" + std::to_string(++counter);
+    auto error_code =
+        krb5_kt_resolve(GetContext(), memory_name.c_str(), &memory_keytab_);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_kt_resolve");
+        memory_keytab_ = nullptr;
+    }
 
-    krb5_keytab_entry entry;
     krb5_kt_cursor cursor{nullptr};
-    auto error_code = krb5_kt_start_seq_get(GetContext(), keytab_, &cursor);
+    error_code = krb5_kt_start_seq_get(GetContext(), keytab_, &cursor);
     if (error_code != 0)
     {
         PrintError(error_code, "krb5_kt_start_seq_get");
-        return principal;
+        CloseMemory();
+        return;
     }
 
-    error_code = krb5_kt_next_entry(GetContext(), keytab_, &entry, &cursor);
-    if (error_code != 0)
+    krb5_keytab_entry entry{};
+    while ((error_code = krb5_kt_next_entry(
+                GetContext(), keytab_, &entry, &cursor)) == 0)
+    {
+        entries_.push_back({Principal{GetContext(), entry.principal},
+                            entry.vno,
+                            entry.key.enctype});
+
+        if (memory_keytab_ != nullptr)
+        {
+            const auto add_code =
+                krb5_kt_add_entry(GetContext(), memory_keytab_, &entry);
+            if (add_code != 0)
+            {
+                PrintError(add_code, "krb5_kt_add_entry");
+                CloseMemory();
+            }
+        }
+
+        const auto free_code = krb5_kt_free_entry(GetContext(), &entry);
+        if (free_code != 0)
+        {
+            PrintError(free_code, "krb5_kt_free_entry");
+        }
+    }
+
+    if (error_code != KRB5_KT_END)
     {
         PrintError(error_code, "krb5_kt_next_entry");
     }
@@ -301,15 +1112,31 @@ shared_ptr<Principal> Keytab::GetPrincipal() const noexcept
         PrintError(error_code, "krb5_kt_end_seq_get");
     }
 
-    principal = make_shared<Principal>(contextPtr(), entry.principal);
+    if (entries_.empty())
+    {
+        CloseMemory();
+    }
+
+    Logging::Info("Загружена таблица ключей {} (записей: {})",
+                  FileName(),
+                  entries_.size());
+}
+
+//------------------------------------------------------------------------------
+void Keytab::CloseMemory() const noexcept
+{
+    if (memory_keytab_ == nullptr)
+    {
+        return;
+    }
 
-    error_code = krb5_kt_free_entry(GetContext(), &entry);
+    auto error_code = krb5_kt_close(GetContext(), memory_keytab_);
     if (error_code != 0)
     {
-        PrintError(error_code, "krb5_kt_free_entry");
+        PrintError(error_code, "krb5_kt_close");
     }
 
-    return principal;
+    memory_keytab_ = nullptr;
 }
 
 //------------------------------------------------------------------------------
@@ -341,18 +1168,27 @@ string Keytab::ConfigName() const noexcept
     Ccache
 ------------------------------------------------------------------------------*/
 Ccache::Ccache(const shared_ptr<_krb5_context> &context,
-                       string_view fullpath) noexcept
+                       string_view fullpath,
+                       string_view principal) noexcept
 : FileInterface(context, fullpath)
+, identity_(Identity(principal))
 {
     FileInterface::Init();
 
-    setenv("KRB5CCNAME", FileName(), 1);
+    if (identity_.empty())
+    {
+        setenv("KRB5CCNAME", FileName(), 1);
+    }
 
     auto error_code = krb5_cc_resolve(GetContext(), FileName(), &ccache_);
     if (error_code != 0)
     {
         PrintError(error_code, "krb5_cc_resolve");
+        return;
     }
+
+    type_ = krb5_cc_get_type(GetContext(), ccache_);
+    SaveTimeOffset();
 }
 
 //------------------------------------------------------------------------------
@@ -361,7 +1197,7 @@ Ccache::~Ccache() noexcept
     if (GetContext() != nullptr && ccache_ != nullptr)
     {
         krb5_error_code error_code{0};
-        if (ProgramType() != "manual")
+        if (ProgramType() != "manual" && owner_ == getpid())
         {
             error_code = krb5_cc_destroy(GetContext(), ccache_);
         }
@@ -378,251 +1214,2501 @@ Ccache::~Ccache() noexcept
 }
 
 //------------------------------------------------------------------------------
-bool Ccache::Create(const shared_ptr<Principal> &principal,
-                        const shared_ptr<Creds> &creds) const noexcept
+bool Ccache::Create(const Principal &principal, Creds creds) const noexcept
 {
-    if (principal == nullptr || creds == nullptr)
+    if (principal.Empty() || creds.Empty())
     {
         return false;
     }
 
-    auto error_code = krb5_cc_initialize(GetContext(), ccache_, principal->ptr());
-    if (error_code != 0)
+    Invalidate();
+
+    if (IsFile())
     {
-        return false;
-    }
+        if (!Replace(principal, creds))
+        {
+            return false;
+        }
 
-    error_code = krb5_cc_store_cred(GetContext(), ccache_, creds->ptr());
-    if (error_code != 0)
+        Restamp();
+    }
+    else if (IsShared())
+    {
+        if (!ReplaceByMove(principal, creds))
+        {
+            return false;
+        }
+    }
+    else
     {
-        PrintError(error_code, "krb5_cc_store_cred");
+        auto error_code = krb5_cc_initialize(GetContext(), ccache_, principal.Ptr());
+        if (error_code != 0)
+        {
+            PrintError(error_code, "krb5_cc_initialize");
+            return false;
+        }
+
+        error_code = krb5_cc_store_cred(GetContext(), ccache_, creds.Ptr());
+        if (error_code != 0)
+        {
+            PrintError(error_code, "krb5_cc_store_cred");
+            return false;
+        }
     }
 
-    return error_code == 0;
+    principal_ = principal.Clone();
+    creds_ = make_shared<Creds>(std::move(creds));
+
+    return true;
 }
 
 //------------------------------------------------------------------------------
 bool Ccache::Update() const noexcept
 {
-    auto principal = GetPrincipal();
-    auto creds = GetCreds();
-    if (principal == nullptr || creds == nullptr)
+    const auto *principal = GetPrincipal();
+    if (principal == nullptr)
     {
         return false;
     }
 
-    auto error_code = krb5_get_renewed_creds(
-        GetContext(), creds->ptr(), principal->ptr(), ccache_, nullptr);
+    krb5_creds creds{};
+    krb5_error_code error_code{0};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_renewed_creds(
+            GetContext(), &creds, principal->Ptr(), ccache_, nullptr);
+    }
     if (error_code != 0)
     {
         PrintError(error_code, "krb5_get_renewed_creds");
         return false;
     }
 
-    return Create(principal, creds);
+    // Имя копируется: Create сбрасывает сохраненное имя клиента.
+    const auto client = principal->Clone();
+    return Create(client, Creds{GetContext(), creds});
 }
 
 //------------------------------------------------------------------------------
-shared_ptr<Creds> Ccache::GetCreds() const noexcept
+shared_ptr<Creds> Ccache::GetServiceCreds(string_view spn) const noexcept
 {
     shared_ptr<Creds> creds_ptr{nullptr};
 
-    auto principal_client = GetPrincipal();
-    if (principal_client == nullptr)
+    const auto *principal = GetPrincipal();
+    if (principal == nullptr)
     {
         return creds_ptr;
     }
 
-    auto principal_server = GetServerPrincipal(principal_client->realm());
-    if (principal_client == nullptr)
+    const string name{spn};
+    krb5_principal server{nullptr};
+    auto error_code = krb5_parse_name(GetContext(), name.c_str(), &server);
+    if (error_code != 0)
     {
+        PrintError(error_code, "krb5_parse_name");
         return creds_ptr;
     }
 
     krb5_creds creds_find{};
-    creds_find.client = principal_client->Ptr();
-    creds_find.server = principal_server->Ptr();
+    creds_find.client = principal->Ptr();
+    creds_find.server = server;
 
-    krb5_creds creds{};
-    auto error_code =
-        krb5_cc_retrieve_cred(GetContext(), ccache_, 0, &creds_find, &creds);
-    if (error_code == 0)
+    krb5_creds *creds{nullptr};
     {
-        creds_ptr = make_shared<Creds>(GetContextPtr(), creds);
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code =
+            krb5_get_credentials(GetContext(), 0, ccache_, &creds_find, &creds);
     }
-    else
+    krb5_free_principal(GetContext(), server);
+
+    if (error_code != 0)
     {
-        PrintError(error_code, "krb5_cc_retrieve_cred");
+        PrintError(error_code, "krb5_get_credentials");
+        return creds_ptr;
+    }
+
+    // Содержимое передается объекту Creds, освобождается только структура.
+    creds_ptr = make_shared<Creds>(GetContext(), *creds);
+    *creds = krb5_creds{};
+    krb5_free_creds(GetContext(), creds);
+
+    if (IsFile())
+    {
+        Restamp();
     }
 
     return creds_ptr;
 }
 
 //------------------------------------------------------------------------------
-shared_ptr<Principal> Ccache::GetPrincipal() const noexcept
+shared_ptr<Creds> Ccache::FindServiceCreds(string_view spn) const noexcept
 {
-    shared_ptr<Principal> principal_ptr{nullptr};
+    shared_ptr<Creds> creds_ptr{nullptr};
 
-    krb5_principal principal{nullptr};
-    auto error_code = krb5_cc_get_principal(GetContext(), ccache_, &principal);
-    if (error_code == 0)
+    const auto lease = ContextPool::Instance().Checkout();
+    krb5_context context = lease.Get();
+    if (context == nullptr)
     {
-        principal_ptr = make_shared<Principal>(GetContextPtr(), principal);
-        krb5_free_principal(GetContext(), principal);
+        return creds_ptr;
     }
-    else
+
+    krb5_ccache ccache{nullptr};
+    auto error_code = krb5_cc_resolve(context, FileName(), &ccache);
+    if (error_code != 0)
     {
-        PrintError(error_code, "krb5_cc_get_principal");
+        PrintError(context, error_code, "krb5_cc_resolve");
+        return creds_ptr;
     }
 
-    return principal_ptr;
-}
-
-//------------------------------------------------------------------------------
-shared_ptr<Principal> Ccache::GetServerPrincipal(
-    string_view realm) const noexcept
-{
-    shared_ptr<Principal> principal_ptr{nullptr};
+    krb5_principal client{nullptr};
+    krb5_principal server{nullptr};
+    const string name{spn};
 
-    krb5_principal principal{nullptr};
+    error_code = krb5_cc_get_principal(context, ccache, &client);
+    if (error_code == 0)
+    {
+        error_code = krb5_parse_name(context, name.c_str(), &server);
+    }
 
-    auto error_code =
-        krb5_build_principal_ext(GetContext(),
-                                 &principal,
-                                 static_cast<unsigned int>(realm.length()),
-                                 realm.data(),
-                                 KRB5_TGS_NAME_SIZE,
-                                 KRB5_TGS_NAME,
-                                 realm.length(),
-                                 realm.data(),
-                                 0);
     if (error_code == 0)
     {
-        principal_ptr = make_shared<Principal>(GetContextPtr(), principal);
-        krb5_free_principal(GetContext(), principal);
+        krb5_creds creds_find{};
+        creds_find.client = client;
+        creds_find.server = server;
+
+        krb5_creds creds{};
+        error_code = krb5_cc_retrieve_cred(context, ccache, 0, &creds_find, &creds);
+        if (error_code == 0)
+        {
+            // Память структур библиотеки не привязана к контексту, поэтому
+            // учетные данные передаются основному контексту: контекст из
+            // пула после возврата используется другими потоками. Основной
+            // контекст используется только для освобождения памяти, а
+            // расхождение часов берется из сохраненного под блокировкой.
+            creds_ptr = make_shared<Creds>(
+                GetContext(), creds, time_offset_.load(std::memory_order_acquire).seconds);
+        }
     }
-    else
+
+    if (error_code != 0 && error_code != KRB5_CC_NOTFOUND &&
+        error_code != KRB5_CC_END && error_code != KRB5_FCC_NOFILE)
     {
-        PrintError(error_code, "krb5_build_principal_ext");
+        PrintError(context, error_code, "krb5_cc_retrieve_cred");
     }
 
-    return principal_ptr;
-}
+    krb5_free_principal(context, server);
+    krb5_free_principal(context, client);
+    krb5_cc_close(context, ccache);
 
-//------------------------------------------------------------------------------
-string Ccache::DefaultName() const noexcept
-{
-    return krb5_cc_default_name(GetContext());
+    return creds_ptr;
 }
 
 //------------------------------------------------------------------------------
-string Ccache::ConfigName() const noexcept
+shared_ptr<Creds> Ccache::GetUserCreds(krb5_context context,
+                                       string_view user) const noexcept
 {
-    auto &cfg = configGlobal::instance();
+    shared_ptr<Creds> creds_ptr{nullptr};
 
-    string fullpath = cfg.variable("system/progpath");
-    fullpath = cfg.variable("kerberos/ccache", fullpath);
-    fullpath += "/krb5cc_" + cfg.variable("system/progname");
+    krb5_ccache ccache = OpenForExchange(context);
+    if (ccache == nullptr)
+    {
+        return creds_ptr;
+    }
 
-    return fullpath;
-}
+    // Билет S4U2Self выдается клиенту кеша для самого себя.
+    krb5_principal server{nullptr};
+    auto error_code = krb5_cc_get_principal(context, ccache, &server);
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_cc_get_principal");
+        krb5_cc_close(context, ccache);
+        return creds_ptr;
+    }
 
-/*------------------------------------------------------------------------------
+    const string name{user};
+    krb5_principal client{nullptr};
+    error_code = krb5_parse_name(context, name.c_str(), &client);
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_parse_name");
+        krb5_free_principal(context, server);
+        krb5_cc_close(context, ccache);
+        return creds_ptr;
+    }
+
+    krb5_creds creds_find{};
+    creds_find.client = client;
+    creds_find.server = server;
+
+    krb5_creds *creds{nullptr};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_credentials_for_user(
+            context, KRB5_GC_NO_STORE, ccache, &creds_find, nullptr, &creds);
+    }
+    krb5_free_principal(context, client);
+    krb5_free_principal(context, server);
+    krb5_cc_close(context, ccache);
+
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_get_credentials_for_user");
+        return creds_ptr;
+    }
+
+    creds_ptr = make_shared<Creds>(
+        GetContext(), *creds, time_offset_.load(std::memory_order_acquire).seconds);
+    *creds = krb5_creds{};
+    krb5_free_creds(context, creds);
+
+    return creds_ptr;
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<Creds> Ccache::GetProxyCreds(krb5_context context,
+                                        const Creds &evidence,
+                                        string_view spn) const noexcept
+{
+    shared_ptr<Creds> creds_ptr{nullptr};
+
+    krb5_ticket *ticket{nullptr};
+    auto error_code = krb5_decode_ticket(&evidence.Ptr()->ticket, &ticket);
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_decode_ticket");
+        return creds_ptr;
+    }
+
+    const string name{spn};
+    krb5_principal server{nullptr};
+    error_code = krb5_parse_name(context, name.c_str(), &server);
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_parse_name");
+        krb5_free_ticket(context, ticket);
+        return creds_ptr;
+    }
+
+    krb5_ccache ccache = OpenForExchange(context);
+    if (ccache == nullptr)
+    {
+        krb5_free_principal(context, server);
+        krb5_free_ticket(context, ticket);
+        return creds_ptr;
+    }
+
+    // Клиентом запрашиваемого билета является пользователь из билета
+    // S4U2Self, сам билет передается KDC как дополнительный.
+    krb5_creds creds_find{};
+    creds_find.client = evidence.Ptr()->client;
+    creds_find.server = server;
+
+    krb5_creds *creds{nullptr};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_credentials_for_proxy(
+            context, KRB5_GC_NO_STORE, ccache, &creds_find, ticket, &creds);
+    }
+    krb5_cc_close(context, ccache);
+    krb5_free_principal(context, server);
+    krb5_free_ticket(context, ticket);
+
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_get_credentials_for_proxy");
+        return creds_ptr;
+    }
+
+    creds_ptr = make_shared<Creds>(
+        GetContext(), *creds, time_offset_.load(std::memory_order_acquire).seconds);
+    *creds = krb5_creds{};
+    krb5_free_creds(context, creds);
+
+    return creds_ptr;
+}
+
+//------------------------------------------------------------------------------
+bool Ccache::Replace(const Principal &principal, Creds &creds) const noexcept
+{
+    string temp_path{FilePath()};
+    temp_path += ".XXXXXX";
+
+    const int fd = mkstemp(temp_path.data());
+    if (fd < 0)
+    {
+        Logging::Error("Ошибка создания временного файла кеша {}: {}", temp_path,
+                       std::strerror(errno));
+        return false;
+    }
+    close(fd);
+
+    const string temp_name{"FILE:" + temp_path};
+    krb5_ccache temp{nullptr};
+    auto error_code = krb5_cc_resolve(GetContext(), temp_name.c_str(), &temp);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_resolve");
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    error_code = krb5_cc_initialize(GetContext(), temp, principal.Ptr());
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_initialize");
+    }
+    else
+    {
+        error_code = krb5_cc_store_cred(GetContext(), temp, creds.Ptr());
+        if (error_code != 0)
+        {
+            PrintError(error_code, "krb5_cc_store_cred");
+        }
+    }
+    krb5_cc_close(GetContext(), temp);
+
+    if (error_code != 0)
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    const string path{FilePath()};
+    if (rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        Logging::Error("Ошибка замены файла кеша {}: {}", path, std::strerror(errno));
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool Ccache::ReplaceByMove(const Principal &principal, Creds &creds) const noexcept
+{
+    krb5_ccache temp{nullptr};
+    auto error_code = krb5_cc_new_unique(GetContext(), type_.c_str(), nullptr, &temp);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_new_unique");
+        return false;
+    }
+
+    error_code = krb5_cc_initialize(GetContext(), temp, principal.Ptr());
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_initialize");
+    }
+    else
+    {
+        error_code = krb5_cc_store_cred(GetContext(), temp, creds.Ptr());
+        if (error_code != 0)
+        {
+            PrintError(error_code, "krb5_cc_store_cred");
+        }
+    }
+
+    if (error_code != 0)
+    {
+        krb5_cc_destroy(GetContext(), temp);
+        return false;
+    }
+
+    // Перемещение не атомарно: прежний кеш очищается и заполняется копией,
+    // при успехе исходный кеш уничтожается функцией перемещения.
+    error_code = krb5_cc_move(GetContext(), temp, ccache_);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_move");
+        krb5_cc_destroy(GetContext(), temp);
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Ccache::SaveTimeOffset() const noexcept
+{
+    TimeOffset offset{};
+    if (krb5_get_time_offsets(GetContext(), &offset.seconds, &offset.microseconds) == 0)
+    {
+        time_offset_.store(offset, std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------------------------
+krb5_ccache Ccache::OpenForExchange(krb5_context context) const noexcept
+{
+    // Без расхождения часов основного контекста отметки времени в запросах
+    // к KDC могут выйти за допустимое отклонение. Основной контекст без
+    // блокировки не используется, расхождение берется из сохраненного.
+    const auto offset = time_offset_.load(std::memory_order_acquire);
+    krb5_set_time_offsets(context, offset.seconds, offset.microseconds);
+
+    krb5_ccache ccache{nullptr};
+    const auto error_code = krb5_cc_resolve(context, FileName(), &ccache);
+    if (error_code != 0)
+    {
+        PrintError(context, error_code, "krb5_cc_resolve");
+        return nullptr;
+    }
+
+    return ccache;
+}
+
+//------------------------------------------------------------------------------
+bool Ccache::Exists() const noexcept
+{
+    if (IsFile())
+    {
+        return FileExists();
+    }
+
+    if (!principal_.Empty() && !IsShared())
+    {
+        return true;
+    }
+
+    krb5_principal principal{nullptr};
+    if (krb5_cc_get_principal(GetContext(), ccache_, &principal) != 0)
+    {
+        return false;
+    }
+
+    principal_ = Principal::Adopt(GetContext(), principal);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+krb5_ccache Ccache::Ptr() const noexcept
+{
+    return ccache_;
+}
+
+//------------------------------------------------------------------------------
+bool Ccache::IsFile() const noexcept
+{
+    return type_ == "FILE";
+}
+
+//------------------------------------------------------------------------------
+bool Ccache::IsShared() const noexcept
+{
+    return type_ == "KEYRING" || type_ == "KCM";
+}
+
+//------------------------------------------------------------------------------
+void Ccache::Disown() noexcept
+{
+    owner_ = 0;
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<Creds> Ccache::GetCreds() const noexcept
+{
+    Revalidate();
+
+    if (creds_ == nullptr)
+    {
+        creds_ = RetrieveCreds();
+    }
+
+    return creds_;
+}
+
+//------------------------------------------------------------------------------
+const Principal *Ccache::GetPrincipal() const noexcept
+{
+    Revalidate();
+
+    if (principal_.Empty())
+    {
+        principal_ = ReadPrincipal();
+    }
+
+    return principal_.Empty() ? nullptr : &principal_;
+}
+
+//------------------------------------------------------------------------------
+const Principal *Ccache::GetServerPrincipal(string_view realm) const noexcept
+{
+    if (server_principal_.Empty() || server_principal_.Realm() != realm)
+    {
+        server_principal_ = BuildServerPrincipal(realm);
+    }
+
+    return server_principal_.Empty() ? nullptr : &server_principal_;
+}
+
+//------------------------------------------------------------------------------
+void Ccache::Revalidate() const noexcept
+{
+    if ((IsFile() && FileChanged()) || IsShared())
+    {
+        Invalidate();
+    }
+}
+
+//------------------------------------------------------------------------------
+void Ccache::Invalidate() const noexcept
+{
+    principal_ = Principal{};
+    creds_ = nullptr;
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<Creds> Ccache::RetrieveCreds() const noexcept
+{
+    shared_ptr<Creds> creds_ptr{nullptr};
+
+    if (principal_.Empty())
+    {
+        principal_ = ReadPrincipal();
+    }
+
+    if (principal_.Empty())
+    {
+        return creds_ptr;
+    }
+
+    const auto *principal_server = GetServerPrincipal(principal_.Realm());
+    if (principal_server == nullptr)
+    {
+        return creds_ptr;
+    }
+
+    krb5_creds creds_find{};
+    creds_find.client = principal_.Ptr();
+    creds_find.server = principal_server->Ptr();
+
+    krb5_creds creds{};
+    auto error_code =
+        krb5_cc_retrieve_cred(GetContext(), ccache_, 0, &creds_find, &creds);
+    if (error_code == 0)
+    {
+        creds_ptr = make_shared<Creds>(GetContext(), creds);
+    }
+    else
+    {
+        PrintError(error_code, "krb5_cc_retrieve_cred");
+    }
+
+    return creds_ptr;
+}
+
+//------------------------------------------------------------------------------
+Principal Ccache::ReadPrincipal() const noexcept
+{
+    krb5_principal principal{nullptr};
+    auto error_code = krb5_cc_get_principal(GetContext(), ccache_, &principal);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_cc_get_principal");
+        return Principal{};
+    }
+
+    return Principal::Adopt(GetContext(), principal);
+}
+
+//------------------------------------------------------------------------------
+Principal Ccache::BuildServerPrincipal(string_view realm) const noexcept
+{
+    krb5_principal principal{nullptr};
+
+    auto error_code =
+        krb5_build_principal_ext(GetContext(),
+                                 &principal,
+                                 static_cast<unsigned int>(realm.length()),
+                                 realm.data(),
+                                 KRB5_TGS_NAME_SIZE,
+                                 KRB5_TGS_NAME,
+                                 static_cast<unsigned int>(realm.length()),
+                                 realm.data(),
+                                 0);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_build_principal_ext");
+        return Principal{};
+    }
+
+    return Principal::Adopt(GetContext(), principal);
+}
+
+//------------------------------------------------------------------------------
+string Ccache::DefaultName() const noexcept
+{
+    string fullpath{krb5_cc_default_name(GetContext())};
+    if (identity_.empty())
+    {
+        return fullpath;
+    }
+
+    if (fullpath.find(':') == string::npos || fullpath.rfind("FILE:", 0) == 0)
+    {
+        return fullpath + "_" + identity_;
+    }
+
+    // Отдельный кеш в коллекции: KEYRING:persistent:<uid>:<имя>, KCM:<uid>:<имя>.
+    const auto separators = std::count(fullpath.begin(), fullpath.end(), ':');
+    if ((fullpath.rfind("KEYRING:persistent:", 0) == 0 && separators == 2) ||
+        (fullpath.rfind("KCM:", 0) == 0 && separators <= 1))
+    {
+        if (fullpath == "KCM:")
+        {
+            fullpath += std::to_string(getuid());
+        }
+        return fullpath + ":krb5cc_" + identity_;
+    }
+
+    return "MEMORY:krb5cc_" + identity_;
+}
+
+//------------------------------------------------------------------------------
+string Ccache::ConfigName() const noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    string name = "krb5cc_" + cfg.variable("system/progname");
+    if (!identity_.empty())
+    {
+        name += "_" + identity_;
+    }
+
+    const string type = cfg.variable("kerberos/ccache_type", "FILE");
+    if (type == "MEMORY")
+    {
+        return "MEMORY:" + name;
+    }
+
+    if (type == "KEYRING")
+    {
+        return "KEYRING:persistent:" + std::to_string(getuid()) + ":" + name;
+    }
+
+    if (type == "KCM")
+    {
+        return "KCM:" + std::to_string(getuid()) + ":" + name;
+    }
+
+    string fullpath = cfg.variable("system/progpath");
+    fullpath = cfg.variable("kerberos/ccache", fullpath);
+    fullpath += "/" + name;
+
+    return fullpath;
+}
+
+/*------------------------------------------------------------------------------
+    Worker
+------------------------------------------------------------------------------*/
+Worker::Worker() noexcept = default;
+
+//------------------------------------------------------------------------------
+Worker::~Worker() noexcept
+{
+    {
+        const std::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+//------------------------------------------------------------------------------
+bool Worker::Post(std::function<void()> task) noexcept
+{
+    // Освобождается после снятия блокировки, при выходе из функции.
+    std::deque<std::function<void()>> abandoned{};
+    {
+        const std::scoped_lock lock(mutex_);
+        abandoned.swap(abandoned_);
+
+        if (stop_)
+        {
+            return false;
+        }
+
+        try
+        {
+            if (!thread_.joinable())
+            {
+                thread_ = std::thread(&Worker::Loop, this);
+            }
+
+            tasks_.push_back(std::move(task));
+        }
+        catch (const std::exception &error)
+        {
+            Logging::Error("Ошибка постановки асинхронной задачи ({})",
+                           error.what());
+            return false;
+        }
+    }
+
+    cv_.notify_one();
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Worker::ForkPrepare() noexcept
+{
+    mutex_.lock();
+}
+
+//------------------------------------------------------------------------------
+void Worker::ForkParent() noexcept
+{
+    mutex_.unlock();
+}
+
+//------------------------------------------------------------------------------
+void Worker::ForkChild() noexcept
+{
+    AbandonThread(thread_);
+    // Обмен очередей не выделяет и не освобождает память.
+    abandoned_.swap(tasks_);
+
+    mutex_.unlock();
+}
+
+//------------------------------------------------------------------------------
+void Worker::Loop() noexcept
+{
+    std::unique_lock lock(mutex_);
+
+    while (true)
+    {
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty())
+        {
+            break;
+        }
+
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+
+        lock.unlock();
+        try
+        {
+            task();
+        }
+        catch (const std::exception &error)
+        {
+            Logging::Error("Ошибка асинхронной задачи ({})", error.what());
+        }
+        lock.lock();
+    }
+}
+
+/*------------------------------------------------------------------------------
+    Backoff
+------------------------------------------------------------------------------*/
+Backoff::Backoff() noexcept
+: min_(std::max(ConfigInteger("kerberos/retry_min", 5), 1L))
+, max_(std::max(ConfigInteger("kerberos/retry_max", 300), min_.count()))
+, jitter_(std::clamp(ConfigDouble("kerberos/refresh_jitter", 0.05), 0.0, 0.5))
+{
+    try
+    {
+        std::random_device device;
+        random_.seed(device());
+    }
+    catch (const std::exception &error)
+    {
+        Logging::Error("Ошибка инициализации генератора случайных чисел ({})",
+                       error.what());
+        random_.seed(static_cast<std::mt19937::result_type>(getpid()));
+    }
+}
+
+//------------------------------------------------------------------------------
+void Backoff::Success() noexcept
+{
+    failures_.store(0, std::memory_order_relaxed);
+    retry_at_.store(0, std::memory_order_release);
+    retry_deadline_.store(0, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+std::chrono::seconds Backoff::Failure() noexcept
+{
+    const auto failures = failures_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    auto delay = min_;
+    for (unsigned int step = 1; step < failures && delay < max_; ++step)
+    {
+        delay *= 2;
+    }
+    delay = std::min(delay, max_);
+
+    // Половина задержки постоянна, вторая половина случайна.
+    const auto half = delay / 2;
+    delay = half + std::chrono::seconds(static_cast<long>(
+                       static_cast<double>((delay - half).count()) * Random()));
+
+    const auto retry_at = std::time(nullptr) + delay.count();
+    retry_at_.store(retry_at, std::memory_order_release);
+    retry_deadline_.store(Clock::Instance().Deadline(retry_at), std::memory_order_release);
+
+    Logging::Error(
+        "Ошибка обновления билета ({} подряд), повторная попытка через {} с",
+        failures,
+        delay.count());
+
+    return delay;
+}
+
+//------------------------------------------------------------------------------
+bool Backoff::Active() const noexcept
+{
+    return Clock::Instance().Now() < retry_deadline_.load(std::memory_order_acquire);
+}
+
+//------------------------------------------------------------------------------
+std::time_t Backoff::RetryAt() const noexcept
+{
+    return retry_at_.load(std::memory_order_acquire);
+}
+
+//------------------------------------------------------------------------------
+unsigned int Backoff::Failures() const noexcept
+{
+    return failures_.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+double Backoff::Jitter() noexcept
+{
+    return jitter_ * Random();
+}
+
+//------------------------------------------------------------------------------
+double Backoff::Random() noexcept
+{
+    const std::scoped_lock lock(random_mutex_);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(random_);
+}
+
+/*------------------------------------------------------------------------------
+    Clock
+------------------------------------------------------------------------------*/
+const Clock &Clock::Instance() noexcept
+{
+    static const Clock instance;
+    return instance;
+}
+
+//------------------------------------------------------------------------------
+Clock::Clock() noexcept
+: id_(CLOCK_BOOTTIME)
+{
+    const string source =
+        configGlobal::instance().variable("kerberos/clock", "boottime");
+    if (source == "coarse")
+    {
+        id_ = CLOCK_MONOTONIC_COARSE;
+    }
+    else if (source == "monotonic")
+    {
+        id_ = CLOCK_MONOTONIC;
+    }
+    else if (source != "boottime")
+    {
+        Logging::Error("Неизвестный источник времени kerberos/clock: {}", source);
+    }
+
+    timespec resolution{};
+    if (clock_getres(id_, &resolution) != 0)
+    {
+        Logging::Error("Часы {} недоступны, используется CLOCK_MONOTONIC", source);
+        id_ = CLOCK_MONOTONIC;
+    }
+}
+
+//------------------------------------------------------------------------------
+std::int64_t Clock::Now() const noexcept
+{
+    constexpr std::int64_t kMsPerSecond{1000};
+    constexpr std::int64_t kNsPerMs{1000000};
+
+    timespec now{};
+    clock_gettime(id_, &now);
+
+    return static_cast<std::int64_t>(now.tv_sec) * kMsPerSecond +
+           static_cast<std::int64_t>(now.tv_nsec) / kNsPerMs;
+}
+
+//------------------------------------------------------------------------------
+std::int64_t Clock::Deadline(std::time_t time) const noexcept
+{
+    if (time == 0)
+    {
+        return 0;
+    }
+
+    constexpr std::int64_t kMsPerSecond{1000};
+
+    return Now() + static_cast<std::int64_t>(time - std::time(nullptr)) * kMsPerSecond;
+}
+
+/*------------------------------------------------------------------------------
+    RefreshPolicy
+------------------------------------------------------------------------------*/
+const RefreshPolicy &RefreshPolicy::Instance() noexcept
+{
+    static const RefreshPolicy instance;
+    return instance;
+}
+
+//------------------------------------------------------------------------------
+RefreshPolicy::RefreshPolicy() noexcept
+: renew_ahead_(std::max(ConfigInteger("kerberos/renew_ahead", 60), 0L))
+, reinit_ahead_(std::max(ConfigInteger("kerberos/reinit_ahead", 60), 0L))
+, min_lifetime_(std::max(ConfigInteger("kerberos/min_lifetime", 300), 0L))
+{
+}
+
+//------------------------------------------------------------------------------
+TicketState RefreshPolicy::Decide(const TicketInfo &info,
+                                  std::time_t now) const noexcept
+{
+    if (now < DueTime(info))
+    {
+        return TicketState::None;
+    }
+
+    return Exchange(info, now);
+}
+
+//------------------------------------------------------------------------------
+TicketState RefreshPolicy::Exchange(const TicketInfo &info,
+                                    std::time_t now) const noexcept
+{
+    // Истекший билет KDC не продлевает.
+    const bool renewable = now < info.end_time && info.renew_till > info.end_time;
+    if (renewable && now < RenewUntil(info))
+    {
+        return TicketState::Renew;
+    }
+
+    return TicketState::Reinit;
+}
+
+//------------------------------------------------------------------------------
+std::time_t RefreshPolicy::DueTime(const TicketInfo &info) const noexcept
+{
+    if (info.end_time == 0)
+    {
+        return 0;
+    }
+
+    const auto reinit_at = info.end_time - Window(reinit_ahead_, info);
+    if (info.renew_till <= info.end_time)
+    {
+        return reinit_at;
+    }
+
+    const auto renew_at = info.end_time - Window(renew_ahead_, info);
+    const auto renew_until = RenewUntil(info);
+    if (renew_at < renew_until)
+    {
+        return renew_at;
+    }
+
+    // К окну продления продленный билет будет слишком коротким: продление
+    // не выполняется, новый билет запрашивается в окне повторного запроса.
+    return std::max(renew_until, reinit_at);
+}
+
+//------------------------------------------------------------------------------
+std::time_t RefreshPolicy::RenewUntil(const TicketInfo &info) const noexcept
+{
+    return info.renew_till - min_lifetime_;
+}
+
+//------------------------------------------------------------------------------
+std::time_t RefreshPolicy::Window(std::time_t window, const TicketInfo &info) noexcept
+{
+    const auto lifetime = std::max(info.end_time - info.start_time, std::time_t{0});
+
+    return std::min(window, lifetime / 2);
+}
+
+/*------------------------------------------------------------------------------
+    TicketSnapshot
+------------------------------------------------------------------------------*/
+void TicketSnapshot::Store(std::time_t start_time,
+                           std::time_t end_time,
+                           std::time_t renew_till) noexcept
+{
+    const auto sequence = sequence_.load(std::memory_order_relaxed);
+
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    start_time_.store(start_time, std::memory_order_relaxed);
+    end_time_.store(end_time, std::memory_order_relaxed);
+    renew_till_.store(renew_till, std::memory_order_relaxed);
+    deadline_.store(Clock::Instance().Deadline(RefreshPolicy::Instance().DueTime(
+                        {start_time, end_time, renew_till})),
+                    std::memory_order_relaxed);
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+TicketInfo TicketSnapshot::Load() const noexcept
+{
+    TicketInfo info{};
+    std::int64_t deadline{0};
+
+    unsigned int sequence{0};
+    do
+    {
+        sequence = sequence_.load(std::memory_order_acquire);
+
+        info.start_time = start_time_.load(std::memory_order_relaxed);
+        info.end_time = end_time_.load(std::memory_order_relaxed);
+        info.renew_till = renew_till_.load(std::memory_order_relaxed);
+        deadline = deadline_.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1U) != 0 ||
+             sequence != sequence_.load(std::memory_order_relaxed));
+
+    // Состояние согласовано с Valid(): срок обновления определяется по
+    // монотонным часам, вид обмена — по временам билета.
+    info.state = Clock::Instance().Now() < deadline
+                     ? TicketState::None
+                     : RefreshPolicy::Instance().Exchange(info, std::time(nullptr));
+
+    return info;
+}
+
+//------------------------------------------------------------------------------
+TicketState TicketSnapshot::StateAt(const TicketInfo &info, std::time_t now) noexcept
+{
+    return RefreshPolicy::Instance().Decide(info, now);
+}
+
+//------------------------------------------------------------------------------
+bool TicketSnapshot::Valid() const noexcept
+{
+    return Clock::Instance().Now() < deadline_.load(std::memory_order_acquire);
+}
+
+/*------------------------------------------------------------------------------
     ServiceImpl
 ------------------------------------------------------------------------------*/
-ServiceImpl::ServiceImpl() noexcept
+ServiceImpl::ServiceImpl(string_view principal,
+                         string_view keytab,
+                         CredsSourceType source) noexcept
+    : principal_name_(principal)
+    , keytab_name_(keytab)
+    , source_type_(source)
+    , ticket_capacity_(static_cast<std::size_t>(
+          std::max(ConfigInteger("kerberos/service_ticket_cache", 256), 0L)))
+    , ticket_ttl_(std::max(ConfigInteger("kerberos/service_ticket_ttl", 3600), 0L) * 1000)
+    , exchange_pool_([this](krb5_context *context) { return InitContext(context); })
+    , impersonations_(
+          static_cast<std::size_t>(std::max(ConfigInteger("kerberos/s4u_cache", 1024), 0L)),
+          static_cast<std::size_t>(
+              std::max(ConfigInteger("kerberos/s4u_cache_bytes", 64L << 20), 0L)))
+{
+    static std::once_flag atfork_flag;
+    std::call_once(atfork_flag, [] {
+        if (pthread_atfork(&PrepareFork, &ParentAfterFork, &ChildAfterFork) != 0)
+        {
+            Logging::Error("Ошибка установки обработчиков fork (pthread_atfork)");
+        }
+    });
+
+    auto &registry = Forks();
+    const std::scoped_lock lock(registry.mutex);
+    registry.services.push_back(this);
+}
+
+//------------------------------------------------------------------------------
+ServiceImpl::~ServiceImpl() noexcept
+{
+    {
+        auto &registry = Forks();
+        const std::scoped_lock lock(registry.mutex);
+        registry.services.erase(
+            std::remove(registry.services.begin(), registry.services.end(), this),
+            registry.services.end());
+    }
+
+    StopRefresher();
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::Init() const noexcept
+{
+    std::call_once(init_flag_, [this] {
+        const ScopedTimer timer(Counters::Instance().init_latency);
+
+        if (KdcRouter::Configured())
+        {
+            kdc_ = make_unique<KdcRouter>();
+        }
+
+        CreateObjects();
+
+        service_spns_ = ConfigList("kerberos/service_tickets");
+
+        if (ccache_ != nullptr && (ccache_->IsFile() || ccache_->IsShared()) &&
+            ConfigInteger("kerberos/shared_cache", 0) != 0)
+        {
+            shared_ = make_unique<SharedTicket>(ccache_->FileName());
+            if (!shared_->Mapped())
+            {
+                shared_.reset();
+            }
+        }
+
+        if (source_ != nullptr && ConfigInteger("kerberos/watch", 1) != 0)
+        {
+            WatchFiles();
+        }
+    });
+
+    if (fork_pending_.load(std::memory_order_acquire))
+    {
+        Reinit();
+    }
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::CreateObjects() const noexcept
+{
+    krb5_context context{nullptr};
+    auto error_code = InitContext(&context);
+    if (error_code != 0)
+    {
+        Logging::Error("Ошибка при инициализации контекста Kerberos (krb5_init_context)");
+        return;
+    }
+
+    context_ = shared_ptr<_krb5_context>{context, krb5_free_context};
+
+    source_ = CredsSource::Create(context_, source_type_, keytab_name_, principal_name_);
+    ccache_ = make_unique<Ccache>(context_, "", principal_name_);
+}
+
+//------------------------------------------------------------------------------
+krb5_error_code ServiceImpl::InitContext(krb5_context *context) const noexcept
+{
+    const auto error_code = kdc_ != nullptr ? kdc_->InitContext(context)
+                                            : krb5_init_context(context);
+
+#ifdef TASP_KRB5_FAULT_INJECTION
+    if (error_code == 0)
+    {
+        FaultInjection::Install(*context);
+    }
+#endif
+
+    return error_code;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::Reinit() const noexcept
+{
+    bool restart{false};
+    {
+        const std::scoped_lock lock(mutex_);
+        if (!fork_pending_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        const ScopedTimer timer(Counters::Instance().init_latency);
+        Logging::Info("Пересоздание контекста Kerberos в процессе {}", getpid());
+
+        const bool watch = watcher_ != nullptr;
+        watcher_.reset();
+        std::atomic_store(&gss_, shared_ptr<const GssHandle>{});
+
+        // Кеш принадлежит родительскому процессу и не удаляется дочерним.
+        if (ccache_ != nullptr)
+        {
+            ccache_->Disown();
+        }
+        ccache_.reset();
+        source_.reset();
+        if (context_ != nullptr)
+        {
+            retired_contexts_.push_back(std::move(context_));
+        }
+
+        CreateObjects();
+        if (ccache_ != nullptr)
+        {
+            ccache_->Disown();
+        }
+
+        {
+            // Очереди могли быть заняты потоками родителя, которых нет в
+            // дочернем процессе; их блокировки не освобождаются, поэтому
+            // записи не удаляются, а оставляются без владельца.
+            const std::scoped_lock impersonation_lock(impersonation_mutex_);
+            for (auto &flight : impersonation_flights_)
+            {
+                static_cast<void>(flight.second.release());
+            }
+            impersonation_flights_.clear();
+        }
+
+        if (watch && source_ != nullptr)
+        {
+            WatchFiles();
+        }
+
+        if (shared_ != nullptr)
+        {
+            shared_->Reopen();
+        }
+
+        restart = std::exchange(refresher_restart_, false);
+        fork_pending_.store(false, std::memory_order_release);
+    }
+
+    if (restart)
+    {
+        // Объекты ServiceImpl создаются неконстантными, константность Init()
+        // относится только к наблюдаемому состоянию.
+        static_cast<void>(const_cast<ServiceImpl *>(this)->StartRefresher());
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::Warmup() const noexcept
+{
+    Init();
+
+    return UpdateCcache();
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> ServiceImpl::WarmupAsync() const noexcept
+{
+    auto promise = make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+
+    Async(&ServiceImpl::Warmup,
+          [promise](bool res) { promise->set_value(res); });
+
+    return future;
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::CreateCcache() const noexcept
+{
+    return CreateCcacheStatus().Ok();
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::UpdateCcache() const noexcept
+{
+    auto &counters = Counters::Instance();
+
+    if (backoff_.Active() && !snapshot_.Valid())
+    {
+        Counters::Increment(counters.update_calls);
+        Counters::Increment(counters.update_backoff);
+        return std::time(nullptr) < snapshot_.Load().end_time;
+    }
+
+    return UpdateCcacheStatus().Ok();
+}
+
+//------------------------------------------------------------------------------
+Status ServiceImpl::CreateCcacheStatus() const noexcept
+{
+    auto &counters = Counters::Instance();
+    Counters::Increment(counters.create_calls);
+
+    const ScopedTimer timer(counters.create_latency);
+    return Flight(&ServiceImpl::CreateLocked);
+}
+
+//------------------------------------------------------------------------------
+Status ServiceImpl::UpdateCcacheStatus() const noexcept
+{
+    auto &counters = Counters::Instance();
+    Counters::Increment(counters.update_calls);
+
+    if (snapshot_.Valid())
+    {
+        // Первый вызов в дочернем процессе пересоздает объекты и запускает
+        // фоновые потоки, не дожидаясь срока обновления билета.
+        if (fork_pending_.load(std::memory_order_relaxed))
+        {
+            Init();
+        }
+
+        Counters::Increment(counters.update_fast);
+        return Status{};
+    }
+
+    if (backoff_.Active())
+    {
+        Counters::Increment(counters.update_backoff);
+        return LastStatus();
+    }
+
+    const ScopedTimer timer(counters.update_latency);
+    return Flight(&ServiceImpl::UpdateLocked);
+}
+
+//------------------------------------------------------------------------------
+Status ServiceImpl::LastStatus() const noexcept
+{
+    return status_.load(std::memory_order_acquire);
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> ServiceImpl::CreateCcacheAsync() const noexcept
+{
+    auto promise = make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+
+    Async(&ServiceImpl::CreateCcache,
+          [promise](bool res) { promise->set_value(res); });
+
+    return future;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::CreateCcacheAsync(
+    std::function<void(bool)> callback) const noexcept
+{
+    Async(&ServiceImpl::CreateCcache, std::move(callback));
+}
+
+//------------------------------------------------------------------------------
+std::future<bool> ServiceImpl::UpdateCcacheAsync() const noexcept
+{
+    auto promise = make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+
+    if (snapshot_.Valid())
+    {
+        auto &counters = Counters::Instance();
+        Counters::Increment(counters.update_calls);
+        Counters::Increment(counters.update_fast);
+
+        promise->set_value(true);
+        return future;
+    }
+
+    Async(&ServiceImpl::UpdateCcache,
+          [promise](bool res) { promise->set_value(res); });
+
+    return future;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::UpdateCcacheAsync(
+    std::function<void(bool)> callback) const noexcept
+{
+    Async(&ServiceImpl::UpdateCcache, std::move(callback));
+}
+
+//------------------------------------------------------------------------------
+string ServiceImpl::CcacheName() const noexcept
+{
+    Init();
+
+    return ccache_ != nullptr ? ccache_->FileName() : "";
+}
+
+//------------------------------------------------------------------------------
+TicketInfo ServiceImpl::Ticket() const noexcept
+{
+    return snapshot_.Load();
+}
+
+//------------------------------------------------------------------------------
+HealthInfo ServiceImpl::Health() const noexcept
+{
+    // Init() не вызывается: проверка не должна создавать контекст и читать
+    // файлы, объект без билета просто не готов.
+    const auto ticket = snapshot_.Load();
+    const std::int64_t now{std::time(nullptr)};
+
+    HealthInfo health{};
+    health.ready = ticket.end_time > now;
+    health.state = ticket.state;
+    health.expires_in = std::max<std::int64_t>(ticket.end_time - now, 0);
+    health.last_status = status_.load(std::memory_order_acquire);
+    health.backoff = backoff_.Active();
+    if (health.backoff)
+    {
+        health.retry_in = std::max<std::int64_t>(backoff_.RetryAt() - now, 0);
+    }
+    health.failures = backoff_.Failures();
+
+    return health;
+}
+
+//------------------------------------------------------------------------------
+TicketInfo ServiceImpl::GetServiceTicket(string_view spn) const noexcept
+{
+    Init();
+
+    const string name{spn};
+
+    auto creds = CachedServiceTicket(name);
+    if (creds != nullptr)
+    {
+        Counters::Increment(Counters::Instance().service_hits);
+        return creds->Info();
+    }
+
+    if (!UpdateCcache())
+    {
+        return TicketInfo{};
+    }
+
+    creds = ccache_->FindServiceCreds(name);
+    if (creds != nullptr && creds->Info().state == TicketState::None)
+    {
+        StoreServiceTicket(name, creds, true);
+
+        return creds->Info();
+    }
+
+    const std::scoped_lock lock(mutex_);
+
+    creds = CachedServiceTicket(name);
+    if (creds == nullptr)
+    {
+        creds = FetchServiceTicketLocked(name, true);
+    }
+
+    return creds != nullptr ? creds->Info() : TicketInfo{};
+}
+
+//------------------------------------------------------------------------------
+TicketInfo ServiceImpl::ImpersonateTicket(string_view user,
+                                          string_view spn) const noexcept
+{
+    Init();
+
+    const string user_name{user};
+    const string name{spn};
+
+    if (Clock::Instance().Now() >= impersonation_sweep_.load(std::memory_order_relaxed) &&
+        impersonation_sweep_.exchange(std::numeric_limits<std::int64_t>::max(),
+                                      std::memory_order_relaxed) !=
+            std::numeric_limits<std::int64_t>::max())
+    {
+        if (!worker_.Post([this] { SweepImpersonations(); }))
+        {
+            SweepImpersonations();
+        }
+    }
+
+    auto creds = CachedImpersonation(user_name, name);
+    if (creds != nullptr)
+    {
+        Counters::Increment(Counters::Instance().s4u_hits);
+        return creds->Info();
+    }
+    Counters::Increment(Counters::Instance().s4u_misses);
+
+    if (!UpdateCcache() || ccache_ == nullptr)
+    {
+        return TicketInfo{};
+    }
+
+    // Обмены с KDC для разных пользователей выполняются параллельно и не
+    // занимают mutex_; потоки одного пользователя ждут в его очереди и
+    // получают билет, запрошенный первым из них.
+    ImpersonationFlight *flight{nullptr};
+    {
+        const std::scoped_lock lock(impersonation_mutex_);
+        auto &entry = impersonation_flights_[user_name];
+        if (entry == nullptr)
+        {
+            entry = make_unique<ImpersonationFlight>();
+        }
+        ++entry->users;
+        flight = entry.get();
+    }
+
+    {
+        const std::scoped_lock lock(flight->mutex);
+        creds = FetchImpersonation(user_name, name);
+    }
+
+    {
+        const std::scoped_lock lock(impersonation_mutex_);
+        if (--flight->users == 0)
+        {
+            impersonation_flights_.erase(user_name);
+        }
+    }
+
+    return creds != nullptr ? creds->Info() : TicketInfo{};
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<const Creds> ServiceImpl::FetchImpersonation(
+    const string &user, const string &spn) const noexcept
+{
+    // Билет мог быть получен предыдущим потоком очереди.
+    auto creds = CachedImpersonation(user, spn);
+    if (creds != nullptr)
+    {
+        return creds;
+    }
+
+    const auto lease = exchange_pool_.Checkout();
+    if (lease.Get() == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto evidence = CachedImpersonation(user, {});
+    if (evidence == nullptr)
+    {
+        Counters::Increment(Counters::Instance().s4u_fetches);
+        evidence = ccache_->GetUserCreds(lease.Get(), user);
+        if (evidence == nullptr)
+        {
+            return nullptr;
+        }
+        StoreImpersonation(user, {}, evidence);
+    }
+
+    if (spn.empty())
+    {
+        return evidence;
+    }
+
+    Counters::Increment(Counters::Instance().s4u_fetches);
+    creds = ccache_->GetProxyCreds(lease.Get(), *evidence, spn);
+    if (creds == nullptr)
+    {
+        return nullptr;
+    }
+    StoreImpersonation(user, spn, creds);
+
+    return creds;
+}
+
+//------------------------------------------------------------------------------
+std::vector<InitiatorToken> ServiceImpl::InitiatorTokens(
+    const std::vector<string> &spns) const noexcept
+{
+    Init();
+
+    std::vector<InitiatorToken> tokens;
+    tokens.reserve(spns.size());
+
+    const auto credential = UpdateCcache() ? AcquireGss() : nullptr;
+    for (const auto &spn : spns)
+    {
+        if (credential == nullptr)
+        {
+            InitiatorToken token{};
+            token.spn = spn;
+            token.major = GSS_S_NO_CRED;
+            tokens.push_back(std::move(token));
+            continue;
+        }
+
+        tokens.push_back(credential->Token(spn));
+    }
+
+    Counters::Instance().gss_tokens.fetch_add(spns.size(), std::memory_order_relaxed);
+
+    return tokens;
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::StartRefresher() noexcept
+{
+    const std::scoped_lock lock(refresher_mutex_);
+
+    if (refresher_.joinable())
+    {
+        return true;
+    }
+
+    const double ratio = ConfigDouble("kerberos/refresh_ratio", refresh_ratio_);
+    if (ratio > 0.0 && ratio <= 1.0)
+    {
+        refresh_ratio_ = ratio;
+    }
+    else
+    {
+        Logging::Error("Недопустимая доля времени обновления билета: {}", ratio);
+    }
+
+    try
+    {
+        refresher_stop_ = false;
+        refresher_ = std::thread(&ServiceImpl::RefresherLoop, this);
+    }
+    catch (const std::system_error &error)
+    {
+        Logging::Error("Ошибка запуска фонового обновления билета ({})",
+                       error.what());
+        return false;
+    }
+
+    Logging::Info("Запущено фоновое обновление билета (доля {})", refresh_ratio_);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::StopRefresher() noexcept
+{
+    std::thread refresher{};
+    {
+        const std::scoped_lock lock(refresher_mutex_);
+        refresher_stop_ = true;
+        refresher.swap(refresher_);
+    }
+
+    refresher_cv_.notify_all();
+
+    if (refresher.joinable())
+    {
+        refresher.join();
+        Logging::Info("Остановлено фоновое обновление билета");
+    }
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::ForkPrepare() noexcept
+{
+    refresher_mutex_.lock();
+    mutex_.lock();
+    tickets_mutex_.lock();
+    impersonation_mutex_.lock();
+    flight_mutex_.lock();
+    exchange_pool_.ForkPrepare();
+    worker_.ForkPrepare();
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::ForkParent() noexcept
+{
+    worker_.ForkParent();
+    exchange_pool_.ForkParent();
+    flight_mutex_.unlock();
+    impersonation_mutex_.unlock();
+    tickets_mutex_.unlock();
+    mutex_.unlock();
+    refresher_mutex_.unlock();
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::ForkChild() noexcept
+{
+    worker_.ForkChild();
+
+    // Потоки, ожидавшие обновления, в дочернем процессе не существуют.
+    for (auto &flight : flights_)
+    {
+        flight.active = false;
+        ++flight.generation;
+    }
+    flight_mutex_.unlock();
+
+    exchange_pool_.ForkChild();
+    impersonation_mutex_.unlock();
+    tickets_mutex_.unlock();
+    mutex_.unlock();
+
+    if (refresher_.joinable())
+    {
+        AbandonThread(refresher_);
+        refresher_restart_ = !refresher_stop_;
+    }
+    refresher_mutex_.unlock();
+
+    if (watcher_ != nullptr)
+    {
+        watcher_->ForkChild();
+    }
+
+    if (shared_ != nullptr)
+    {
+        shared_->ForkChild();
+    }
+    leader_refresher_.store(false, std::memory_order_relaxed);
+
+    // Объект, не инициализированный до fork(), инициализируется в дочернем
+    // процессе обычным образом.
+    if (context_ != nullptr)
+    {
+        fork_pending_.store(true, std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------------------------
+std::chrono::steady_clock::time_point ServiceImpl::KdcBegin(
+    string_view realm) const noexcept
+{
+    if (kdc_ != nullptr)
+    {
+        kdc_->Prepare(realm);
+    }
+
+    return std::chrono::steady_clock::now();
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::KdcEnd(std::chrono::steady_clock::time_point start,
+                         bool res) const noexcept
+{
+    if (kdc_ != nullptr)
+    {
+        kdc_->Record(std::chrono::steady_clock::now() - start,
+                     Context::MakeStatus(res).category);
+    }
+}
+
+//------------------------------------------------------------------------------
+Status ServiceImpl::Flight(bool (ServiceImpl::*task)() const, bool fresh) const noexcept
+{
+    Init();
+
+    std::unique_lock flight_lock(flight_mutex_);
+    auto &flight = FlightOf(task);
+
+    if (flight.active && fresh)
+    {
+        // Выполнение, начатое до вызова, могло прочитать прежние файлы.
+        Counters::Increment(Counters::Instance().flight_waits);
+        flight_cv_.wait(flight_lock, [&flight] { return !flight.active; });
+    }
+
+    if (flight.active)
+    {
+        Counters::Increment(Counters::Instance().flight_waits);
+
+        const auto generation = flight.generation;
+        flight_cv_.wait(flight_lock, [&flight, generation] {
+            return flight.generation != generation;
+        });
+
+        return flight.result;
+    }
+
+    flight.active = true;
+    flight_lock.unlock();
+
+    Status res{};
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const std::scoped_lock lock(mutex_);
+        Counters::Instance().lock_wait.Add(std::chrono::steady_clock::now() - start);
+
+        Context::ResetLastError();
+        res = Context::MakeStatus((this->*task)());
+
+        if (ccache_ != nullptr)
+        {
+            ccache_->SaveTimeOffset();
+        }
+    }
+
+    if (res.Ok())
+    {
+        backoff_.Success();
+    }
+    else
+    {
+        backoff_.Failure();
+    }
+    status_.store(res, std::memory_order_release);
+
+    flight_lock.lock();
+    flight.active = false;
+    flight.result = res;
+    ++flight.generation;
+    flight_lock.unlock();
+
+    flight_cv_.notify_all();
+
+    return res;
+}
+
+//------------------------------------------------------------------------------
+ServiceImpl::FlightState &ServiceImpl::FlightOf(
+    bool (ServiceImpl::*task)() const) const noexcept
+{
+    for (auto &flight : flights_)
+    {
+        if (flight.task == task)
+        {
+            return flight;
+        }
+    }
+
+    return flights_.back();
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::Async(bool (ServiceImpl::*call)() const,
+                        std::function<void(bool)> callback) const noexcept
+{
+    auto task = [this, call, callback] {
+        const bool res = (this->*call)();
+        if (callback)
+        {
+            callback(res);
+        }
+    };
+
+    if (!worker_.Post(task))
+    {
+        Logging::Error("Асинхронная операция выполняется синхронно");
+        task();
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::CreateLocked() const noexcept
+{
+    if (ccache_ == nullptr || source_ == nullptr)
+    {
+        return false;
+    }
+
+    Logging::Info("Создание Ccache {}", ccache_->FileName());
+
+    const auto *principal = source_->GetPrincipal();
+    bool res{false};
+    if (principal != nullptr)
+    {
+        const auto start = KdcBegin(principal->Realm());
+        auto creds = source_->GetCreds(*principal);
+        KdcEnd(start, !creds.Empty());
+
+        res = ccache_->Create(*principal, std::move(creds));
+    }
+    auto &counters = Counters::Instance();
+    Counters::Increment(res ? counters.reinit_ok : counters.reinit_failed);
+    if (res)
+    {
+        auto ccache_creds = ccache_->GetCreds();
+        if (ccache_creds != nullptr)
+        {
+            Logging::Info("Время действия билета {}", ccache_creds->TimesInfo());
+        }
+        Publish(ccache_creds);
+        FetchServiceTicketsLocked();
+    }
+    else
+    {
+        Publish(ccache_->Exists() ? ccache_->GetCreds() : nullptr);
+    }
+
+    return res;
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::UpdateLocked() const noexcept
+{
+    if (ccache_ == nullptr)
+    {
+        return false;
+    }
+
+    if (AdoptSharedLocked())
+    {
+        return true;
+    }
+
+    if (!ccache_->Exists())
+    {
+        return CreateLocked();
+    }
+
+    auto creds = ccache_->GetCreds();
+    if (creds == nullptr)
+    {
+        return false;
+    }
+
+    bool res{false};
+    switch (creds->State())
+    {
+        case Creds::State::Renew:
+            Logging::Info("Продление Ccache");
+            res = RenewLocked();
+            if (!res)
+            {
+                Logging::Info("Ошибка продления Ccache. Повторное создание");
+                res = CreateLocked();
+            }
+            break;
+
+        case Creds::State::Reinit:
+            res = CreateLocked();
+            break;
+        default:
+            Publish(creds);
+            res = true;
+            break;
+    }
+
+    return res;
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::RefreshLocked() const noexcept
 {
-    krb5_context context{nullptr};
-    auto error_code = krb5_init_context(&context);
-    if (error_code == 0)
+    if (ccache_ == nullptr)
     {
-        const shared_ptr<_krb5_context> context_ptr{context, krb5_free_context};
+        return false;
+    }
 
-        keytab_ = make_unique<Keytab>(context_ptr, keytab);
-        ccache_ = make_unique<Ccache>(context_ptr, ccache);
+    if (AdoptSharedLocked())
+    {
+        return true;
     }
-    else
+
+    auto creds = ccache_->Exists() ? ccache_->GetCreds() : nullptr;
+    if (creds == nullptr)
     {
-        Logging::Error("Ошибка при инициализации контекста Kerberos (krb5_init_context)");
+        return CreateLocked();
+    }
+
+    const auto info = creds->Info();
+    if (info.state == TicketState::None && !creds->RefreshDue(refresh_ratio_))
+    {
+        Publish(creds);
+        return true;
+    }
+
+    bool res{false};
+    if (RefreshPolicy::Instance().Exchange(info, std::time(nullptr)) ==
+        TicketState::Renew)
+    {
+        Logging::Info("Фоновое продление Ccache");
+        res = RenewLocked();
+        if (!res)
+        {
+            Logging::Info("Ошибка фонового продления Ccache. Повторное создание");
+        }
     }
+
+    if (!res)
+    {
+        res = CreateLocked();
+    }
+
+    return res;
 }
 
 //------------------------------------------------------------------------------
-ServiceImpl::~ServiceImpl() = default;
+bool ServiceImpl::RenewLocked() const noexcept
+{
+    const auto *principal = ccache_->GetPrincipal();
+    const auto start = KdcBegin(principal != nullptr ? principal->Realm() : string_view{});
+    const bool res = ccache_->Update();
+    KdcEnd(start, res);
+
+    auto &counters = Counters::Instance();
+    Counters::Increment(res ? counters.renew_ok : counters.renew_failed);
+    if (res)
+    {
+        auto ccache_creds = ccache_->GetCreds();
+        if (ccache_creds != nullptr)
+        {
+            Logging::Info("Время действия билета {}", ccache_creds->TimesInfo());
+        }
+        Publish(ccache_creds);
+        FetchServiceTicketsLocked();
+    }
+
+    return res;
+}
 
 //------------------------------------------------------------------------------
-bool ServiceImpl::CreateCcache() const noexcept
+shared_ptr<GssCredential> ServiceImpl::AcquireGss() const noexcept
 {
-    const std::scoped_lock lock(_mutex);
+    auto creds = std::atomic_load(&creds_);
+    auto tickets = tickets_generation_.load(std::memory_order_acquire);
+    auto handle = std::atomic_load(&gss_);
+    if (handle != nullptr && handle->source == creds && handle->tickets == tickets)
+    {
+        return handle->credential;
+    }
 
-    if (ccache_ == nullptr || keytab_ == nullptr)
+    const std::scoped_lock lock(mutex_);
+
+    creds = std::atomic_load(&creds_);
+    tickets = tickets_generation_.load(std::memory_order_acquire);
+    handle = std::atomic_load(&gss_);
+    if (handle != nullptr && handle->source == creds && handle->tickets == tickets)
     {
-        return false;
+        return handle->credential;
     }
 
-    Logging::Info("Создание Ccache");
+    auto principal = ccache_->GetPrincipal();
+    if (creds == nullptr || principal == nullptr)
+    {
+        return nullptr;
+    }
 
-    auto principal = keytab_->GetPrincipal();
-    auto creds = keytab_->GetCreds();
+    // Билеты сервисов удерживаются до создания учетных данных GSSAPI,
+    // которые хранят их копии.
+    std::vector<shared_ptr<const Creds>> services;
+    std::vector<const krb5_creds *> source{creds->Ptr()};
+    {
+        const std::shared_lock tickets_lock(tickets_mutex_);
+        services.reserve(tickets_.size());
+        for (const auto &ticket : tickets_)
+        {
+            if (ticket.second.creds != nullptr)
+            {
+                services.push_back(ticket.second.creds);
+                source.push_back(ticket.second.creds->Ptr());
+            }
+        }
+    }
 
-    const bool res = ccache_->Create(principal, creds);
-    if (res)
+    auto credential = GssCredential::Import(principal->Ptr(), source);
+    if (credential == nullptr)
     {
-        auto ccache_creds = ccache_->getCreds();
-        Logging::Info("Время действия билета {}", ccache_creds->TimesInfo());
+        return nullptr;
     }
 
-    return res;
+    Counters::Increment(Counters::Instance().gss_imports);
+    std::atomic_store(&gss_, shared_ptr<const GssHandle>{make_shared<GssHandle>(
+                                 GssHandle{creds, tickets, credential})});
+
+    return credential;
 }
 
 //------------------------------------------------------------------------------
-bool ServiceImpl::UpdateCcache() const noexcept
+bool ServiceImpl::AdoptSharedLocked() const noexcept
 {
-    const std::scoped_lock lock(_mutex);
+    if (shared_ == nullptr)
+    {
+        return false;
+    }
+
+    if (shared_->Leader())
+    {
+        // Ведущим может стать процесс без запросов (например, родитель
+        // рабочих процессов), поэтому он обновляет билет для всех процессов
+        // в фоне. Поток запускается через worker_: mutex_ захватывается
+        // после refresher_mutex_.
+        if (!leader_refresher_.exchange(true, std::memory_order_relaxed))
+        {
+            static_cast<void>(worker_.Post([this] {
+                static_cast<void>(const_cast<ServiceImpl *>(this)->StartRefresher());
+            }));
+        }
+        return false;
+    }
+
+    auto &counters = Counters::Instance();
+    const auto known = snapshot_.Load();
+
+    // Поток запроса не ожидает ведущего: если опубликованный билет требует
+    // обновления, обмен с KDC выполняется самостоятельно.
+    const auto info = shared_->Load();
+    if (info.state != TicketState::None)
+    {
+        Counters::Increment(counters.shared_fallbacks);
+        Logging::Info("Ведущий процесс не обновил билет. Обновление "
+                      "выполняется самостоятельно");
+        return false;
+    }
+
+    if (info.end_time == known.end_time && known.state == TicketState::None)
+    {
+        return true;
+    }
+
+    auto creds = ccache_->Exists() ? ccache_->GetCreds() : nullptr;
+    if (creds == nullptr || creds->Info().state != TicketState::None)
+    {
+        return false;
+    }
+
+    Counters::Increment(counters.shared_adopted);
+    Publish(creds);
+
+    return true;
+}
 
+//------------------------------------------------------------------------------
+bool ServiceImpl::CheckLocked() const noexcept
+{
     if (ccache_ == nullptr)
     {
         return false;
     }
 
-    if (!ccache_->FileExists())
+    // События от собственной записи кеша (замена переименованием, сохранение
+    // билетов сервисов) обрабатываются после Restamp() под той же
+    // блокировкой, и файл совпадает с запомненными сведениями.
+    if (ccache_->IsFile() && ccache_->FileMatchesStamp())
     {
-        return CreateCcache();
+        return true;
     }
 
-    auto creds = ccache_->GetCreds();
+    auto creds = ccache_->Exists() ? ccache_->GetCreds() : nullptr;
     if (creds == nullptr)
     {
-        return false;
+        Logging::Info("Кеш учетных данных {} удален или поврежден. Повторное создание",
+                      ccache_->FileName());
+        return CreateLocked();
     }
 
-    bool res{false};
-    switch (creds->State())
+    Publish(creds);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::WatchFiles() const noexcept
+{
+    try
+    {
+        watcher_ = make_unique<FileWatcher>();
+    }
+    catch (const std::bad_alloc &error)
+    {
+        Logging::Error("Ошибка создания отслеживания файлов ({})", error.what());
+        return;
+    }
+
+    source_->Watch(*watcher_, [this] {
+        if (shared_ != nullptr && !shared_->Leader())
+        {
+            return;
+        }
+
+        Logging::Info("Изменен файл учетных данных {}. Повторный запрос билета",
+                      source_->FileName());
+        worker_.Post([this] {
+            static_cast<void>(Flight(&ServiceImpl::CreateLocked, true));
+        });
+    });
+
+    ccache_->Watch(*watcher_, [this] {
+        worker_.Post([this] { static_cast<void>(Flight(&ServiceImpl::CheckLocked)); });
+    });
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::FetchServiceTicketsLocked() const noexcept
+{
+    const auto now = Clock::Instance().Now();
+
+    std::vector<string> spns{service_spns_};
     {
-        case Creds::STATE::RENEW:
-            _log.tolog_info("Update ccache");
-            res = _ccache->update();
-            if (res)
+        const std::scoped_lock lock(tickets_mutex_);
+        for (auto ticket = tickets_.begin(); ticket != tickets_.end();)
+        {
+            if (ConfiguredService(ticket->first))
             {
-                auto ccache_creds = _ccache->getCreds();
-                _log.tolog_info("Creds time\n%s", ccache_creds->timesInfo());
+                ++ticket;
+                continue;
             }
-            else
+
+            // Билет без обращений не обновляется: при следующем запросе он
+            // будет получен заново.
+            if (now - ticket->second.used.load(std::memory_order_relaxed) >= ticket_ttl_)
             {
-                _log.tolog_info("Update ccache error. REINIT");
-                res = createCcache();
+                ticket = tickets_.erase(ticket);
+                continue;
             }
-            break;
 
-        case Creds::STATE::REINIT:
-            res = createCcache();
-            break;
-        default:
-            res = true;
-            break;
+            spns.push_back(ticket->first);
+            ++ticket;
+        }
     }
 
-    return res;
+    for (const auto &spn : spns)
+    {
+        FetchServiceTicketLocked(spn, false);
+    }
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<const Creds> ServiceImpl::FetchServiceTicketLocked(
+    const string &spn, bool touch) const noexcept
+{
+    Counters::Increment(Counters::Instance().service_fetches);
+
+    shared_ptr<const Creds> creds{ccache_->GetServiceCreds(spn)};
+    if (creds == nullptr)
+    {
+        return creds;
+    }
+
+    StoreServiceTicket(spn, creds, touch);
+
+    return creds;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::StoreServiceTicket(const string &spn,
+                                     shared_ptr<const Creds> creds,
+                                     bool touch) const noexcept
+{
+    const auto now = Clock::Instance().Now();
+
+    const std::scoped_lock lock(tickets_mutex_);
+
+    const auto [ticket, inserted] = tickets_.try_emplace(spn);
+    ticket->second.creds = std::move(creds);
+    tickets_generation_.fetch_add(1, std::memory_order_release);
+    if (touch || inserted)
+    {
+        ticket->second.used.store(now, std::memory_order_relaxed);
+    }
+
+    if (!inserted || ticket_capacity_ == 0 || tickets_.size() <= ticket_capacity_)
+    {
+        return;
+    }
+
+    // Вытесняется билет с самым давним обращением. Поиск линейный: он
+    // выполняется только при добавлении сервиса сверх ограничения.
+    auto oldest = tickets_.end();
+    for (auto item = tickets_.begin(); item != tickets_.end(); ++item)
+    {
+        if (item == ticket || ConfiguredService(item->first))
+        {
+            continue;
+        }
+
+        if (oldest == tickets_.end() ||
+            item->second.used.load(std::memory_order_relaxed) <
+                oldest->second.used.load(std::memory_order_relaxed))
+        {
+            oldest = item;
+        }
+    }
+
+    if (oldest != tickets_.end())
+    {
+        tickets_.erase(oldest);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ServiceImpl::ConfiguredService(const string &spn) const noexcept
+{
+    return std::find(service_spns_.begin(), service_spns_.end(), spn) !=
+           service_spns_.end();
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<const Creds> ServiceImpl::CachedServiceTicket(
+    const string &spn) const noexcept
+{
+    const std::shared_lock lock(tickets_mutex_);
+
+    const auto ticket = tickets_.find(spn);
+    if (ticket == tickets_.end() ||
+        ticket->second.creds->Info().state != TicketState::None)
+    {
+        return nullptr;
+    }
+
+    // Запись выполняется не чаще раза в секунду, чтобы частые обращения
+    // из разных потоков не конкурировали за строку кеша процессора.
+    constexpr std::int64_t kTouchInterval{1000};
+    const auto now = Clock::Instance().Now();
+    if (now - ticket->second.used.load(std::memory_order_relaxed) >= kTouchInterval)
+    {
+        ticket->second.used.store(now, std::memory_order_relaxed);
+    }
+
+    return ticket->second.creds;
+}
+
+//------------------------------------------------------------------------------
+shared_ptr<const Creds> ServiceImpl::CachedImpersonation(
+    const string &user, const string &spn) const noexcept
+{
+    const std::scoped_lock lock(impersonation_mutex_);
+
+    const auto *entry = impersonations_.Find(user);
+    if (entry == nullptr)
+    {
+        return nullptr;
+    }
+
+    shared_ptr<const Creds> creds{entry->evidence};
+    if (!spn.empty())
+    {
+        const auto ticket = entry->proxies.find(spn);
+        creds = ticket != entry->proxies.end() ? ticket->second : nullptr;
+    }
+
+    if (creds == nullptr || creds->Info().state != TicketState::None)
+    {
+        return nullptr;
+    }
+
+    return creds;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::StoreImpersonation(const string &user,
+                                     const string &spn,
+                                     shared_ptr<const Creds> creds) const noexcept
+{
+    const std::scoped_lock lock(impersonation_mutex_);
+
+    const auto entries = impersonations_.Size();
+    const auto bytes = impersonations_.Bytes();
+
+    auto *entry = impersonations_.Find(user);
+    if (entry == nullptr)
+    {
+        entry = &impersonations_.Insert(user, Impersonation{});
+    }
+
+    if (spn.empty())
+    {
+        // Билеты сервисов получены по прежнему билету S4U2Self и остаются
+        // действительными до окончания своего срока.
+        entry->evidence = std::move(creds);
+    }
+    else
+    {
+        entry->proxies[spn] = std::move(creds);
+    }
+
+    // Пользователь хранится до окончания действия последнего из его
+    // билетов; истекшие билеты сервисов заменяются при следующем запросе.
+    std::size_t size = sizeof(Impersonation) + user.size();
+    std::time_t end_time{0};
+    if (entry->evidence != nullptr)
+    {
+        size += entry->evidence->Size();
+        end_time = entry->evidence->LocalTime(entry->evidence->EndTime());
+    }
+    for (const auto &proxy : entry->proxies)
+    {
+        size += proxy.first.size() + proxy.second->Size();
+        end_time = std::max(end_time, proxy.second->LocalTime(proxy.second->EndTime()));
+    }
+
+    const auto evicted =
+        impersonations_.Charge(user, size, Clock::Instance().Deadline(end_time));
+    Counters::Instance().s4u_evictions.fetch_add(evicted, std::memory_order_relaxed);
+
+    AccountImpersonations(entries, bytes);
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::SweepImpersonations() const noexcept
+{
+    const std::scoped_lock lock(impersonation_mutex_);
+
+    const auto entries = impersonations_.Size();
+    const auto bytes = impersonations_.Bytes();
+
+    const auto expired = impersonations_.EvictExpired(Clock::Instance().Now());
+    Counters::Instance().s4u_expired.fetch_add(expired, std::memory_order_relaxed);
+
+    AccountImpersonations(entries, bytes);
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::AccountImpersonations(std::size_t entries,
+                                        std::size_t bytes) const noexcept
+{
+    // Счетчики общие для объектов процесса, поэтому изменяются на разность,
+    // уменьшение выполняется сложением по модулю.
+    auto &counters = Counters::Instance();
+    counters.s4u_entries.fetch_add(impersonations_.Size() - entries,
+                                   std::memory_order_relaxed);
+    counters.s4u_bytes.fetch_add(impersonations_.Bytes() - bytes,
+                                 std::memory_order_relaxed);
+
+    impersonation_sweep_.store(impersonations_.NextExpiry(), std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::Publish(const shared_ptr<Creds> &creds) const noexcept
+{
+    std::atomic_store(&creds_, shared_ptr<const Creds>{creds});
+
+    if (creds != nullptr)
+    {
+        const auto info = creds->Info();
+        snapshot_.Store(info.start_time, info.end_time, info.renew_till);
+
+        if (shared_ != nullptr)
+        {
+            shared_->Store(info.start_time, info.end_time, info.renew_till);
+        }
+    }
+    else
+    {
+        snapshot_.Store(0, 0, 0);
+    }
+}
+
+//------------------------------------------------------------------------------
+std::chrono::system_clock::time_point ServiceImpl::NextRefresh() const noexcept
+{
+    auto next = std::chrono::system_clock::now();
+
+    const auto creds = std::atomic_load(&creds_);
+    if (creds != nullptr)
+    {
+        const double ratio = std::max(refresh_ratio_ - backoff_.Jitter(), 0.0);
+        const auto due = RefreshPolicy::Instance().DueTime(creds->Info());
+        next = std::chrono::system_clock::from_time_t(
+            std::min(creds->LocalTime(creds->RefreshTime(ratio)), due));
+    }
+
+    return next;
+}
+
+//------------------------------------------------------------------------------
+void ServiceImpl::RefresherLoop() noexcept
+{
+    auto wakeup = NextRefresh();
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(refresher_mutex_);
+            if (refresher_cv_.wait_until(
+                    lock, wakeup, [this] { return refresher_stop_; }))
+            {
+                break;
+            }
+        }
+
+        const bool res = Flight(&ServiceImpl::RefreshLocked).Ok();
+
+        const auto now = std::chrono::system_clock::now();
+        wakeup = res ? std::max(NextRefresh(), now + kRefreshMinInterval)
+                     : std::chrono::system_clock::from_time_t(backoff_.RetryAt());
+    }
 }
 
 }  // namespace tasp::krb5
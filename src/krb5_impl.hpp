@@ -5,15 +5,118 @@
 #ifndef TASP_KRB5_IMPL_HPP_
 #define TASP_KRB5_IMPL_HPP_
 
+#include "tasp/krb5.hpp"
+
+#include "krb5_gss.hpp"
+#include "krb5_kdc.hpp"
+#include "krb5_lru.hpp"
+#include "krb5_pool.hpp"
+#include "krb5_shared.hpp"
+#include "krb5_watch.hpp"
+
 #include <krb5.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
 
 namespace tasp::krb5
 {
 
+/**
+ * @brief Чтение целочисленного параметра из глобальной конфигурации.
+ *
+ * @param key Название параметра
+ * @param default_value Значение по умолчанию
+ *
+ * @return Значение параметра или значение по умолчанию, если параметр не
+ * задан или задан с ошибкой
+ */
+long ConfigInteger(std::string_view key, long default_value) noexcept;
+
+/**
+ * @brief Чтение вещественного параметра из глобальной конфигурации.
+ *
+ * @param key Название параметра
+ * @param default_value Значение по умолчанию
+ *
+ * @return Значение параметра или значение по умолчанию, если параметр не
+ * задан или задан с ошибкой
+ */
+double ConfigDouble(std::string_view key, double default_value) noexcept;
+
+/**
+ * @brief Чтение списка значений из глобальной конфигурации.
+ *
+ * @param key Название параметра
+ *
+ * @return Значения, разделенные запятыми или пробелами
+ */
+std::vector<std::string> ConfigList(std::string_view key) noexcept;
+
+/**
+ * @brief Приведение имени клиента к полной форме.
+ *
+ * Имя разбирается библиотекой Kerberos (с добавлением области по
+ * умолчанию, если она не указана) и формируется заново, поэтому записи
+ * одного клиента (svc/host и svc/host@REALM) совпадают.
+ *
+ * @param name Уникальное имя клиента
+ *
+ * @return Полное имя или исходное имя, если его не удалось разобрать
+ */
+std::string CanonicalPrincipal(std::string_view name) noexcept;
+
+/**
+ * @brief Отказ от потока родительского процесса в дочернем процессе после
+ * fork().
+ *
+ * Поток в дочернем процессе не существует, поэтому объект потока
+ * отсоединяется без ожидания завершения.
+ *
+ * @param thread Объект потока
+ */
+void AbandonThread(std::thread &thread) noexcept;
+
+/**
+ * @brief Освобождение параметров запроса билета.
+ */
+struct InitCredsOptDeleter
+{
+    krb5_context context{nullptr}; /*!< Контекст, в котором созданы параметры */
+
+    /**
+     * @brief Освобождение параметров.
+     *
+     * @param options Параметры запроса билета
+     */
+    void operator()(krb5_get_init_creds_opt *options) const noexcept;
+};
+
+/**
+ * @brief Параметры запроса билета.
+ */
+using InitCredsOpt = std::unique_ptr<krb5_get_init_creds_opt, InitCredsOptDeleter>;
+
 /**
  * @brief Базовый класс для всех классов работы с Kerberos.
  */
@@ -32,6 +135,42 @@ public:
      */
     virtual ~Context() noexcept;
 
+    /**
+     * @brief Ввод сообщения об ошибке в глобальный лог с текстом ошибки из
+     * указанного контекста.
+     *
+     * @param context Контекст, в котором произошла ошибка
+     * @param code Код ошибки от вызова функции бибилиотеки Kerberos
+     * @param message Сопровождающее сообщение к коду ошибки
+     */
+    static void PrintError(krb5_context context,
+                           krb5_error_code code,
+                           std::string_view message) noexcept;
+
+    /**
+     * @brief Определение категории ошибки библиотеки Kerberos.
+     *
+     * @param code Код ошибки, отличный от нуля
+     *
+     * @return Категория ошибки
+     */
+    static ErrorCategory Category(krb5_error_code code) noexcept;
+
+    /**
+     * @brief Запуск учета ошибок операции в текущем потоке.
+     */
+    static void ResetLastError() noexcept;
+
+    /**
+     * @brief Формирование результата операции по последней ошибке,
+     * переданной в PrintError() текущим потоком после ResetLastError().
+     *
+     * @param res Результат операции
+     *
+     * @return Результат с кодом и категорией ошибки
+     */
+    static Status MakeStatus(bool res) noexcept;
+
     Context(const Context &) = delete;
     Context(Context &&) = delete;
     Context &operator=(const Context &) = delete;
@@ -43,7 +182,7 @@ protected:
      *
      * @return Указатель на структуру
      */
-    inline _krb5_context *GetContext() const noexcept;
+    _krb5_context *GetContext() const noexcept;
 
     /**
      * @brief Получение умного указателя на структуру главной библиотеки Kerberos.
@@ -70,23 +209,73 @@ private:
 
 /**
  * @brief Класс для работы c уникальным именем клиента Kerberos.
+ *
+ * Объект владеет структурой имени и хранит указатель на контекст без
+ * владения, поэтому может храниться по значению и перемещаться без
+ * выделения памяти и атомарных операций. Контекст должен существовать
+ * дольше объекта.
  */
-class Principal : public Context final
+class Principal final
 {
 public:
     /**
-     * @brief Конструктор.
+     * @brief Конструктор пустого имени.
+     */
+    Principal() noexcept = default;
+
+    /**
+     * @brief Конструктор с копированием имени.
      * 
      * @param context Главная структура библиотеки Kerberos
      * @param principal Структура с уникальным именем клиента библиотеки
      */
-    Principal(const std::shared_ptr<_krb5_context> &context,
-                  krb5_const_principal principal) noexcept;
+    Principal(krb5_context context, krb5_const_principal principal) noexcept;
 
     /**
      * @brief Деструктор.
      */
-    ~Principal() noexcept override;
+    ~Principal() noexcept;
+
+    /**
+     * @brief Конструктор перемещения.
+     *
+     * @param other Перемещаемый объект
+     */
+    Principal(Principal &&other) noexcept;
+
+    /**
+     * @brief Оператор перемещения.
+     *
+     * @param other Перемещаемый объект
+     *
+     * @return Ссылка на объект
+     */
+    Principal &operator=(Principal &&other) noexcept;
+
+    /**
+     * @brief Передача во владение структуры, полученной от библиотеки
+     * Kerberos, без копирования.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     * @param principal Структура с уникальным именем клиента
+     *
+     * @return Объект, владеющий структурой
+     */
+    static Principal Adopt(krb5_context context, krb5_principal principal) noexcept;
+
+    /**
+     * @brief Копирование имени.
+     *
+     * @return Копия
+     */
+    Principal Clone() const noexcept;
+
+    /**
+     * @brief Проверка отсутствия имени.
+     *
+     * @return Результат проверки
+     */
+    bool Empty() const noexcept;
 
     /**
      * @brief Запрос названия области клиента Kerberos.
@@ -104,11 +293,19 @@ public:
     krb5_principal Ptr() const noexcept;
 
     Principal(const Principal &) = delete;
-    Principal(Principal &&) = delete;
     Principal &operator=(const Principal &) = delete;
-    Principal &operator=(Principal &&) = delete;
 
 private:
+    /**
+     * @brief Освобождение структуры.
+     */
+    void Reset() noexcept;
+
+    /**
+     * @brief Главная структура библиотеки Kerberos (без владения).
+     */
+    krb5_context context_{nullptr};
+
     /**
      * @brief Структура с уникальным именем клиента.
      */
@@ -117,23 +314,65 @@ private:
 
 /**
  * @brief Класс для работы с учетными данными Kerberos.
+ *
+ * Объект владеет содержимым структуры учетных данных и хранит указатель на
+ * контекст без владения. Контекст должен существовать дольше объекта.
  */
-class Creds : public Context final
+class Creds final
 {
 public:
     /**
-     * @brief Конструктор.
+     * @brief Конструктор пустых учетных данных.
+     */
+    Creds() noexcept = default;
+
+    /**
+     * @brief Конструктор. Содержимое структуры передается во владение
+     * объекту.
      * 
      * @param context Главная структура библиотеки Kerberos
      * @param creds Структура с учетными данными библиотеки Kerberos
      */
-    Creds(const std::shared_ptr<_krb5_context> &context,
-              krb5_creds creds) noexcept;
+    Creds(krb5_context context, krb5_creds creds) noexcept;
+
+    /**
+     * @brief Конструктор с заданным расхождением часов с KDC. Не вызывает
+     * функций библиотеки Kerberos на контексте, поэтому используется вне
+     * блокировки контекста.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     * @param creds Структура с учетными данными библиотеки Kerberos
+     * @param offset Расхождение часов с KDC, с
+     */
+    Creds(krb5_context context, krb5_creds creds, std::time_t offset) noexcept;
 
     /**
      * @brief Деструктор.
      */
-    ~Creds() noexcept override;
+    ~Creds() noexcept;
+
+    /**
+     * @brief Конструктор перемещения.
+     *
+     * @param other Перемещаемый объект
+     */
+    Creds(Creds &&other) noexcept;
+
+    /**
+     * @brief Оператор перемещения.
+     *
+     * @param other Перемещаемый объект
+     *
+     * @return Ссылка на объект
+     */
+    Creds &operator=(Creds &&other) noexcept;
+
+    /**
+     * @brief Проверка отсутствия учетных данных.
+     *
+     * @return Результат проверки
+     */
+    bool Empty() const noexcept;
 
     /**
      * @brief Статусы состояния учетных записей.
@@ -173,6 +412,54 @@ public:
      */
     krb5_timestamp RenewTime() const noexcept;
 
+    /**
+     * @brief Запрос времени упреждающего обновления билета.
+     *
+     * @param ratio Доля времени действия билета, после которой требуется
+     * обновление
+     *
+     * @return Время обновления
+     */
+    krb5_timestamp RefreshTime(double ratio) const noexcept;
+
+    /**
+     * @brief Перевод времени билета в локальное время.
+     *
+     * Время пересчитывается с учетом расхождения часов с KDC, запомненного
+     * при создании объекта, чтобы его можно было сравнивать с std::time() без
+     * обращения к контексту библиотеки Kerberos.
+     *
+     * @param timestamp Время билета
+     *
+     * @return Локальное время или 0, если время билета не задано
+     */
+    std::time_t LocalTime(krb5_timestamp timestamp) const noexcept;
+
+    /**
+     * @brief Оценка памяти, занимаемой учетными данными: объект, имена
+     * клиента и сервера, ключ сессии, билеты, адреса и данные авторизации.
+     *
+     * @return Размер, байт
+     */
+    std::size_t Size() const noexcept;
+
+    /**
+     * @brief Формирование сведений о билете по локальным часам.
+     *
+     * @return Сведения о билете
+     */
+    TicketInfo Info() const noexcept;
+
+    /**
+     * @brief Проверка наступления времени упреждающего обновления билета.
+     *
+     * @param ratio Доля времени действия билета, после которой требуется
+     * обновление
+     *
+     * @return Результат проверки
+     */
+    bool RefreshDue(double ratio) const noexcept;
+
     /**
      * @brief Формирование строки с информацией о временах билета.
      *
@@ -196,16 +483,47 @@ public:
      */
     krb5_creds *Ptr() noexcept;
 
+    /**
+     * @brief Получение указателя на неизменяемую структуру с учетными данными.
+     *
+     * @return Указатель на структуру
+     */
+    const krb5_creds *Ptr() const noexcept;
+
     Creds(const Creds &) = delete;
-    Creds(Creds &&) = delete;
     Creds &operator=(const Creds &) = delete;
-    Creds &operator=(Creds &&) = delete;
 
 private:
+    /**
+     * @brief Текущее время по часам KDC.
+     *
+     * @return Время
+     */
+    krb5_timestamp Now() const noexcept;
+
+    /**
+     * @brief Освобождение содержимого структуры.
+     */
+    void Reset() noexcept;
+
+    /**
+     * @brief Главная структура библиотеки Kerberos (без владения).
+     */
+    krb5_context context_{nullptr};
+
     /**
      * @brief Структура с учетными данными.
      */
-    krb5_creds creds_;
+    krb5_creds creds_{};
+
+    /**
+     * @brief Расхождение часов KDC с локальными на момент создания объекта.
+     *
+     * Запоминается, чтобы проверки времени билета из разных потоков не
+     * обращались к контексту, которым в это время может пользоваться поток,
+     * выполняющий обновление.
+     */
+    std::time_t offset_{0};
 };
 
 /**
@@ -235,6 +553,42 @@ public:
      */
     bool FileExists() const noexcept;
 
+    /**
+     * @brief Проверка изменения файла с момента предыдущей проверки.
+     *
+     * Сравниваются устройство, индексный дескриптор, размер и время
+     * модификации файла. Первая проверка всегда сообщает об изменении. Если
+     * файл отслеживается, stat выполняется только после события изменения.
+     *
+     * @return Результат проверки
+     */
+    bool FileChanged() const noexcept;
+
+    /**
+     * @brief Проверка, что файл совпадает со сведениями, запомненными при
+     * предыдущей проверке или записи файла объектом.
+     *
+     * В отличие от FileChanged() не сбрасывает признак изменения и не
+     * обновляет сведения, поэтому следующая FileChanged() обнаружит
+     * изменение.
+     *
+     * @return true, если устройство, индексный дескриптор, размер и время
+     * модификации файла не изменились
+     */
+    bool FileMatchesStamp() const noexcept;
+
+    /**
+     * @brief Отслеживание изменений файла.
+     *
+     * @param watcher Объект отслеживания
+     * @param callback Функция, вызываемая потоком отслеживания при изменении
+     * файла
+     *
+     * @return Результат добавления: false, если файл не является локальным
+     * файлом или отслеживание недоступно
+     */
+    bool Watch(FileWatcher &watcher, std::function<void()> callback) noexcept;
+
     /**
      * @brief Запрос имени файла.
      *
@@ -252,9 +606,10 @@ public:
     /**
      * @brief Получение имени клиента.
      *
-     * @return Уникальное имя клиента Kerberos
+     * @return Уникальное имя клиента Kerberos или nullptr. Указатель действует
+     * до следующего изменения объекта
      */
-    virtual std::shared_ptr<Principal> GetPrincipal() const noexcept = 0;
+    virtual const Principal *GetPrincipal() const noexcept = 0;
 
     /**
      * @brief Полный путь к стандартному расположению файла.
@@ -288,217 +643,1858 @@ protected:
      */
     inline std::string_view ProgramType() const noexcept;
 
-private:
     /**
-     * @brief Полный путь к файлу.
+     * @brief Путь к файлу без префикса типа.
+     *
+     * @return Путь к файлу
      */
-    std::string fullpath_;
+    std::string_view FilePath() const noexcept;
 
     /**
-     * @brief Тип запуска программы.
+     * @brief Запоминание сведений о файле после его записи.
+     *
+     * @return Результат сравнения с предыдущими сведениями
      */
-    std::string program_type_{"manual"};
-};
+    bool Restamp() const noexcept;
 
-/**
- * @brief Класс для работы с таблицей ключей Kerberos.
- */
-class Keytab : public FileInterface final
-{
-public:
+private:
     /**
-     * @brief Конструктор.
-     * 
-     * @param context Главная структура библиотеки Kerberos
-     * @param fullpath Полный путь к таблице ключей.
+     * @brief Сведения о файле для обнаружения его изменения.
      */
-    Keytab(const std::shared_ptr<_krb5_context> &context,
-               std::string_view fullpath) noexcept;
+    struct FileStamp
+    {
+        bool exists{false};     /*!< Файл существует */
+        dev_t device{0};        /*!< Устройство */
+        ino_t inode{0};         /*!< Индексный дескриптор */
+        off_t size{0};          /*!< Размер */
+        time_t mtime_sec{0};    /*!< Время модификации, секунды */
+        long mtime_nsec{0};     /*!< Время модификации, наносекунды */
+    };
 
-   /**
-     * @brief Деструктор.
+    /**
+     * @brief Чтение сведений о файле.
+     *
+     * @return Сведения о файле
      */
-    ~Keytab() noexcept override;
+    FileStamp ReadStamp() const noexcept;
 
     /**
-     * @brief Формирование учетных данных из таблицы ключей Kerberos.
+     * @brief Сравнение сведений о файле с запомненными.
      *
-     * @return Учетные данных Kerberos
+     * @param stamp Сведения о файле
+     *
+     * @return true, если сведения запомнены и совпадают
      */
-    std::shared_ptr<Creds> GetCreds() const noexcept override;
+    bool SameStamp(const FileStamp &stamp) const noexcept;
 
     /**
-     * @brief Получение имени клиента из таблицы ключей Kerberos.
-     *
-     * @return Уникальное имя клиента Kerberos
+     * @brief Полный путь к файлу.
      */
-    std::shared_ptr<Principal> GetPrincipal() const noexcept override;
+    std::string fullpath_;
 
     /**
-     * @brief Полный путь к стандартной таблице ключей.
-     *
-     * @return Полный путь к таблице ключей
+     * @brief Сведения о файле при предыдущей проверке.
      */
-    std::string DefaultName() const noexcept override;
+    mutable FileStamp stamp_{};
 
     /**
-     * @brief Полный путь к таблице ключей из конфигурационного файла.
-     *
-     * @return Полный путь к таблице ключей
+     * @brief Признак наличия предыдущей проверки файла.
      */
-    std::string ConfigName() const noexcept override;
+    mutable bool stamp_valid_{false};
 
-    Keytab(const Keytab &) = delete;
-    Keytab(Keytab &&) = delete;
-    Keytab &operator=(const Keytab &) = delete;
-    Keytab &operator=(Keytab &&) = delete;
+    /**
+     * @brief Признак изменения файла, устанавливаемый потоком отслеживания.
+     */
+    mutable std::atomic<bool> changed_{true};
 
-private:
     /**
-     * @brief Структура таблицы ключей Kerberos.
+     * @brief Признак отслеживания файла.
      */
-    krb5_keytab keytab_{nullptr};
+    std::atomic<bool> watched_{false};
+
+    /**
+     * @brief Тип запуска программы.
+     */
+    std::string program_type_{"manual"};
 };
 
 /**
- * @brief Класс для работы с кешем учетных данных Kerberos.
+ * @brief Общий интерфейс источников начальных учетных данных клиента.
+ *
+ * Источник выбирается параметром kerberos/creds_source: keytab (таблица
+ * ключей, по умолчанию), pkinit (сертификат клиента) или agent (пароль,
+ * выдаваемый внешним агентом через локальный сокет). Файл источника
+ * отслеживается так же, как таблица ключей: при его замене билет
+ * запрашивается повторно.
  */
-class Ccache : public FileInterface final
+class CredsSource : public FileInterface
 {
 public:
     /**
      * @brief Конструктор.
-     * 
+     *
      * @param context Главная структура библиотеки Kerberos
-     * @param fullpath Полный путь к кешу учетных данных.
+     * @param fullpath Полный путь к файлу источника
+     * @param principal Имя клиента или пустая строка
      */
-    Ccache(const std::shared_ptr<_krb5_context> &context,
-               std::string_view fullpath) noexcept;
+    CredsSource(const std::shared_ptr<_krb5_context> &context,
+                std::string_view fullpath,
+                std::string_view principal) noexcept;
 
     /**
      * @brief Деструктор.
      */
-    ~Ccache() noexcept override;
+    ~CredsSource() noexcept override;
 
     /**
-     * @brief Создание кеша учетных данных с помощью уникального имени
-     * клиента и учетных данных Kerberos.
+     * @brief Создание источника учетных данных.
      *
-     * @param principal Уникальное имя клиента Kerberos
-     * @param creds Учетные данных Kerberos
-     * 
-     * @return Результат создания
+     * @param context Главная структура библиотеки Kerberos
+     * @param type Тип источника; CredsSourceType::Config — тип из параметра
+     * kerberos/creds_source
+     * @param fullpath Полный путь к файлу источника или пустая строка для
+     * пути из конфигурации
+     * @param principal Имя клиента или пустая строка
+     *
+     * @return Источник учетных данных
      */
-    bool Create(const std::shared_ptr<Principal> &principal,
-                const std::shared_ptr<Creds> &creds) const noexcept;
+    static std::unique_ptr<CredsSource> Create(
+        const std::shared_ptr<_krb5_context> &context,
+        CredsSourceType type,
+        std::string_view fullpath,
+        std::string_view principal) noexcept;
 
     /**
-     * @brief Обновление кеша учетных данных Kerberos.
+     * @brief Формирование учетных данных для клиента источника.
      *
-     * @return Результат обновления
+     * @return Учетные данных Kerberos или nullptr при ошибке
      */
-    bool Update() const noexcept;
+    std::shared_ptr<Creds> GetCreds() const noexcept override;
 
     /**
-     * @brief Формирование учетных данных из кеша учетных данных Kerberos.
+     * @brief Формирование учетных данных для заданного клиента.
      *
-     * @return Учетные данных Kerberos
+     * @param principal Уникальное имя клиента Kerberos
+     *
+     * @return Учетные данных Kerberos, пустые при ошибке
      */
-    std::shared_ptr<Creds> GetCreds() const noexcept override;
+    virtual Creds GetCreds(const Principal &principal) const noexcept = 0;
 
     /**
-     * @brief Получение имени клиента из кеша учетных данных Kerberos.
+     * @brief Получение имени клиента, заданного при создании источника или
+     * параметром kerberos/principal.
      *
-     * @return Уникальное имя клиента Kerberos
+     * @return Уникальное имя клиента Kerberos или nullptr, если имя не
+     * задано или недопустимо
      */
-    std::shared_ptr<Principal> GetPrincipal() const noexcept override;
+    const Principal *GetPrincipal() const noexcept override;
+
+    CredsSource(const CredsSource &) = delete;
+    CredsSource(CredsSource &&) = delete;
+    CredsSource &operator=(const CredsSource &) = delete;
+    CredsSource &operator=(CredsSource &&) = delete;
 
+protected:
     /**
-     * @brief Получение имени сервера из кеша учетных данных Kerberos.
+     * @brief Формирование параметров запроса билета.
      *
-     * @param realm Название области
-     * 
-     * @return Уникальное имя сервера Kerberos
+     * @param required Выделение параметров, даже если время действия и
+     * продления билета берутся из krb5.conf
+     *
+     * @return Параметры или nullptr, если используются параметры по умолчанию
      */
-    std::shared_ptr<Principal> GetServerPrincipal(
-        std::string_view realm) const noexcept;
+    InitCredsOpt InitCredsOptions(bool required = false) const noexcept;
 
     /**
-     * @brief Полный путь к стандартному кешу учетных данных.
+     * @brief Запрос заданного имени клиента.
      *
-     * @return Полный путь к кешу учетных данных
+     * @return Имя клиента, пустое, если не задано
      */
-    std::string DefaultName() const noexcept override;
+    const Principal &ConfiguredPrincipal() const noexcept;
 
     /**
-     * @brief Полный путь к кешу учетных данных из конфигурационного файла.
+     * @brief Проверка, что имя клиента задано, но не разобрано.
      *
-     * @return Полный путь к кешу учетных данных
+     * @return true, если учетные данные не должны запрашиваться ни для
+     * какого клиента
+     */
+    bool PrincipalInvalid() const noexcept;
+
+private:
+    /**
+     * @brief Заданное имя клиента.
+     */
+    Principal principal_{};
+
+    /**
+     * @brief Признак заданного, но недопустимого имени клиента.
+     */
+    bool principal_invalid_{false};
+
+    /**
+     * @brief Запрашиваемое время действия билета, с. Ноль — по настройкам
+     * krb5.conf.
+     */
+    krb5_deltat ticket_lifetime_{0};
+
+    /**
+     * @brief Запрашиваемое время продления билета, с. Ноль — по настройкам
+     * krb5.conf.
+     */
+    krb5_deltat renew_lifetime_{0};
+};
+
+/**
+ * @brief Класс для работы с таблицей ключей Kerberos.
+ */
+class Keytab final : public CredsSource
+{
+public:
+    /**
+     * @brief Конструктор.
+     * 
+     * @param context Главная структура библиотеки Kerberos
+     * @param fullpath Полный путь к таблице ключей.
+     * @param principal Имя клиента или пустая строка для первой записи
+     */
+    Keytab(const std::shared_ptr<_krb5_context> &context,
+               std::string_view fullpath,
+               std::string_view principal) noexcept;
+
+   /**
+     * @brief Деструктор.
+     */
+    ~Keytab() noexcept override;
+
+    using CredsSource::GetCreds;
+
+    /**
+     * @brief Формирование учетных данных из таблицы ключей Kerberos для
+     * заданного клиента.
+     *
+     * Используется копия таблицы ключей в памяти, поэтому файл повторно не
+     * читается.
+     *
+     * @param principal Уникальное имя клиента Kerberos
+     *
+     * @return Учетные данных Kerberos, пустые при ошибке
+     */
+    Creds GetCreds(const Principal &principal) const noexcept override;
+
+    /**
+     * @brief Получение имени клиента из таблицы ключей Kerberos.
+     *
+     * Возвращается запись заданного при создании клиента, либо первая запись.
+     * Таблица ключей перечитывается только при изменении файла.
+     *
+     * @return Уникальное имя клиента Kerberos или nullptr
+     */
+    const Principal *GetPrincipal() const noexcept override;
+
+    /**
+     * @brief Полный путь к стандартной таблице ключей.
+     *
+     * @return Полный путь к таблице ключей
+     */
+    std::string DefaultName() const noexcept override;
+
+    /**
+     * @brief Полный путь к таблице ключей из конфигурационного файла.
+     *
+     * @return Полный путь к таблице ключей
      */
     std::string ConfigName() const noexcept override;
 
-    Ccache(const Ccache &) = delete;
-    Ccache(Ccache &&) = delete;
-    Ccache &operator=(const Ccache &) = delete;
-    Ccache &operator=(Ccache &&) = delete;
+    Keytab(const Keytab &) = delete;
+    Keytab(Keytab &&) = delete;
+    Keytab &operator=(const Keytab &) = delete;
+    Keytab &operator=(Keytab &&) = delete;
 
 private:
     /**
-     * @brief Структура кеша учетных данных Kerberos.
+     * @brief Запись таблицы ключей.
      */
-    krb5_ccache ccache_{nullptr};
+    struct Entry
+    {
+        Principal principal;                  /*!< Уникальное имя клиента */
+        krb5_kvno kvno;                       /*!< Версия ключа */
+        krb5_enctype enctype;                 /*!< Тип шифрования ключа */
+    };
+
+    /**
+     * @brief Чтение всех записей таблицы ключей за один проход и формирование
+     * их копии в памяти.
+     */
+    void Load() const noexcept;
+
+    /**
+     * @brief Закрытие копии таблицы ключей в памяти.
+     */
+    void CloseMemory() const noexcept;
+
+    /**
+     * @brief Структура таблицы ключей Kerberos.
+     */
+    krb5_keytab keytab_{nullptr};
+
+    /**
+     * @brief Копия таблицы ключей в памяти (MEMORY:).
+     */
+    mutable krb5_keytab memory_keytab_{nullptr};
+
+    /**
+     * @brief Записи таблицы ключей. Перечитываются при изменении файла.
+     */
+    mutable std::vector<Entry> entries_{};
 };
 
 /**
- * @brief Интерфейс реализация для аутентификации Kerberos сервисом.
+ * @brief Класс для работы с кешем учетных данных Kerberos.
  */
-class ServiceImpl final
+class Ccache final : public FileInterface
 {
 public:
     /**
      * @brief Конструктор.
+     * 
+     * @param context Главная структура библиотеки Kerberos
+     * @param fullpath Полный путь к кешу учетных данных.
+     * @param principal Имя клиента для отдельного кеша или пустая строка для
+     * кеша по умолчанию
      */
-    ServiceImpl() noexcept;
+    Ccache(const std::shared_ptr<_krb5_context> &context,
+               std::string_view fullpath,
+               std::string_view principal) noexcept;
 
     /**
      * @brief Деструктор.
      */
-    ~ServiceImpl() noexcept;
+    ~Ccache() noexcept override;
 
     /**
-     * @brief Создание кеша учетных данных.
+     * @brief Создание кеша учетных данных с помощью уникального имени
+     * клиента и учетных данных Kerberos.
      *
+     * @param principal Уникальное имя клиента Kerberos
+     * @param creds Учетные данных Kerberos
+     * 
      * @return Результат создания
      */
-    [[nodiscard]] bool CreateCcache() const noexcept;
+    bool Create(const Principal &principal, Creds creds) const noexcept;
 
     /**
-     * @brief Обновление кеша учетных данных.
+     * @brief Обновление кеша учетных данных Kerberos.
      *
      * @return Результат обновления
      */
-    [[nodiscard]] bool UpdateCcache() const noexcept;
+    bool Update() const noexcept;
 
-    ServiceImpl(const ServiceImpl &) = delete;
-    ServiceImpl(ServiceImpl &&) = delete;
-    ServiceImpl &operator=(const ServiceImpl &) = delete;
-    ServiceImpl &operator=(ServiceImpl &&) = delete;
+    /**
+     * @brief Проверка существования кеша учетных данных.
+     *
+     * Для файлового кеша проверяется наличие файла, для кеша в памяти —
+     * наличие в нем имени клиента.
+     *
+     * @return Результат проверки
+     */
+    bool Exists() const noexcept;
+
+    /**
+     * @brief Проверка хранения кеша учетных данных в файле.
+     *
+     * @return Результат проверки
+     */
+    bool IsFile() const noexcept;
+
+    /**
+     * @brief Проверка хранения кеша вне процесса и вне файла (KEYRING, KCM).
+     *
+     * Такой кеш может изменяться другими процессами без изменения файлов,
+     * поэтому имя клиента и учетные данные не сохраняются между
+     * обращениями, а наличие кеша проверяется через его хранилище.
+     *
+     * @return Результат проверки
+     */
+    bool IsShared() const noexcept;
+
+    /**
+     * @brief Отказ от удаления кеша при разрушении объекта.
+     *
+     * Вызывается в дочернем процессе: кеш, созданный родительским процессом,
+     * используется им и другими дочерними процессами.
+     */
+    void Disown() noexcept;
+
+    /**
+     * @brief Формирование учетных данных из кеша учетных данных Kerberos.
+     *
+     * @return Учетные данных Kerberos
+     */
+    std::shared_ptr<Creds> GetCreds() const noexcept override;
+
+    /**
+     * @brief Получение имени клиента из кеша учетных данных Kerberos.
+     *
+     * @return Уникальное имя клиента Kerberos или nullptr
+     */
+    const Principal *GetPrincipal() const noexcept override;
+
+    /**
+     * @brief Получение билета для сервиса.
+     *
+     * Билет берется из кеша учетных данных или запрашивается у KDC с помощью
+     * билета на получение билетов и сохраняется в кеше, где его находят
+     * GSSAPI и другие пользователи кеша.
+     *
+     * @param spn Имя сервиса (например, postgres/db.example.com@REALM)
+     *
+     * @return Учетные данные сервиса
+     */
+    std::shared_ptr<Creds> GetServiceCreds(std::string_view spn) const noexcept;
+
+    /**
+     * @brief Поиск билета для сервиса в кеше учетных данных без обращения к
+     * KDC.
+     *
+     * Выполняется на контексте из пула и не требует блокировки основного
+     * контекста, поэтому может вызываться несколькими потоками одновременно.
+     *
+     * @param spn Имя сервиса
+     *
+     * @return Учетные данные сервиса или nullptr, если билета нет в кеше
+     */
+    std::shared_ptr<Creds> FindServiceCreds(std::string_view spn) const noexcept;
+
+    /**
+     * @brief Сохранение расхождения часов с KDC, учтенного в основном
+     * контексте, для операций на контекстах из пула.
+     *
+     * Вызывается под блокировкой основного контекста после обменов с KDC.
+     */
+    void SaveTimeOffset() const noexcept;
+
+    /**
+     * @brief Получение билета для клиента кеша от имени пользователя
+     * (S4U2Self).
+     *
+     * Обмен с KDC выполняется на переданном контексте без блокировки
+     * основного и без вызовов на нем; учетные данные передаются основному
+     * контексту для освобождения. Билет не сохраняется в кеше учетных
+     * данных.
+     *
+     * @param context Контекст, используемый только текущим потоком
+     * @param user Уникальное имя пользователя Kerberos
+     *
+     * @return Учетные данные или nullptr при ошибке
+     */
+    std::shared_ptr<Creds> GetUserCreds(krb5_context context,
+                                        std::string_view user) const noexcept;
+
+    /**
+     * @brief Получение билета для сервиса от имени пользователя по билету,
+     * полученному через S4U2Self (ограниченное делегирование, S4U2Proxy).
+     *
+     * Обмен с KDC выполняется на переданном контексте без блокировки
+     * основного и без вызовов на нем; учетные данные передаются основному
+     * контексту для освобождения. Билет не сохраняется в кеше учетных
+     * данных.
+     *
+     * @param context Контекст, используемый только текущим потоком
+     * @param evidence Билет пользователя для клиента кеша
+     * @param spn Имя сервиса
+     *
+     * @return Учетные данные или nullptr при ошибке
+     */
+    std::shared_ptr<Creds> GetProxyCreds(krb5_context context,
+                                         const Creds &evidence,
+                                         std::string_view spn) const noexcept;
+
+    /**
+     * @brief Получение имени сервера выдачи билетов для области.
+     *
+     * @param realm Название области
+     * 
+     * @return Уникальное имя сервера Kerberos или nullptr
+     */
+    const Principal *GetServerPrincipal(std::string_view realm) const noexcept;
+
+    /**
+     * @brief Получение указателя на структуру кеша учетных данных библиотеки
+     * Kerberos.
+     *
+     * @return Указатель на структуру
+     */
+    krb5_ccache Ptr() const noexcept;
+
+    /**
+     * @brief Полный путь к стандартному кешу учетных данных.
+     *
+     * @return Полный путь к кешу учетных данных
+     */
+    std::string DefaultName() const noexcept override;
+
+    /**
+     * @brief Полный путь к кешу учетных данных из конфигурационного файла.
+     *
+     * При kerberos/ccache_type = MEMORY формируется имя кеша в памяти
+     * процесса, при KEYRING — имя кеша в постоянной коллекции ключей ядра
+     * пользователя (KEYRING:persistent:<uid>:<имя>), при KCM — имя кеша
+     * в службе KCM (KCM:<uid>:<имя>).
+     *
+     * @return Полный путь к кешу учетных данных
+     */
+    std::string ConfigName() const noexcept override;
+
+    Ccache(const Ccache &) = delete;
+    Ccache(Ccache &&) = delete;
+    Ccache &operator=(const Ccache &) = delete;
+    Ccache &operator=(Ccache &&) = delete;
 
 private:
     /**
-     * Структура таблицы ключей Kerberos.
+     * @brief Запись файлового кеша во временный файл и его замена
+     * переименованием.
+     *
+     * Процессы и библиотеки, читающие кеш во время обновления, видят
+     * либо прежний, либо новый кеш, но не пустой файл между
+     * krb5_cc_initialize и krb5_cc_store_cred.
+     *
+     * @param principal Уникальное имя клиента
+     * @param creds Учетные данные
+     *
+     * @return Результат замены
+     */
+    bool Replace(const Principal &principal, Creds &creds) const noexcept;
+
+    /**
+     * @brief Запись кеша KEYRING или KCM в новый кеш той же коллекции и его
+     * перемещение на место прежнего (krb5_cc_move).
+     *
+     * В отличие от Replace() замена не атомарна: krb5_cc_move в MIT
+     * Kerberos выполняет krb5_cc_initialize для прежнего кеша и копирует в
+     * него учетные данные, поэтому читающий в этот момент процесс может
+     * увидеть кеш без билетов. Обмен с KDC выполняется до перемещения, что
+     * сокращает это окно до копирования одного билета.
+     *
+     * @param principal Уникальное имя клиента
+     * @param creds Учетные данные
+     *
+     * @return Результат замены
+     */
+    bool ReplaceByMove(const Principal &principal, Creds &creds) const noexcept;
+
+    /**
+     * @brief Открытие кеша на контексте для обмена с KDC и перенос в этот
+     * контекст расхождения часов с KDC, сохраненного SaveTimeOffset().
+     *
+     * @param context Контекст, используемый только текущим потоком
+     *
+     * @return Кеш, закрываемый вызывающим через krb5_cc_close, или nullptr
+     */
+    krb5_ccache OpenForExchange(krb5_context context) const noexcept;
+
+    /**
+     * @brief Сброс сохраненных данных при изменении файла кеша.
+     */
+    void Revalidate() const noexcept;
+
+    /**
+     * @brief Сброс сохраненных имени клиента и учетных данных.
+     */
+    void Invalidate() const noexcept;
+
+    /**
+     * @brief Чтение учетных данных из кеша учетных данных Kerberos.
+     *
+     * @return Учетные данных Kerberos
+     */
+    std::shared_ptr<Creds> RetrieveCreds() const noexcept;
+
+    /**
+     * @brief Чтение имени клиента из кеша учетных данных Kerberos.
+     *
+     * @return Уникальное имя клиента Kerberos
+     */
+    Principal ReadPrincipal() const noexcept;
+
+    /**
+     * @brief Формирование имени сервера выдачи билетов для области.
+     *
+     * @param realm Название области
+     *
+     * @return Уникальное имя сервера Kerberos
+     */
+    Principal BuildServerPrincipal(
+        std::string_view realm) const noexcept;
+
+    /**
+     * @brief Расхождение часов с KDC.
+     */
+    struct TimeOffset
+    {
+        krb5_timestamp seconds{0};   /*!< Секунды */
+        krb5_int32 microseconds{0};  /*!< Микросекунды */
+    };
+
+    /**
+     * @brief Структура кеша учетных данных Kerberos.
+     */
+    krb5_ccache ccache_{nullptr};
+
+    /**
+     * @brief Расхождение часов с KDC основного контекста, сохраненное
+     * SaveTimeOffset(). Читается без блокировки потоками, использующими
+     * контексты из пула.
+     */
+    mutable std::atomic<TimeOffset> time_offset_{TimeOffset{}};
+
+    /**
+     * @brief Часть имени кеша, выделенного для отдельного клиента.
+     */
+    std::string identity_{};
+
+    /**
+     * @brief Тип кеша учетных данных (FILE, MEMORY).
+     */
+    std::string type_{};
+
+    /**
+     * @brief Идентификатор процесса, который удаляет кеш при разрушении
+     * объекта, 0 — кеш не удаляется.
+     */
+    pid_t owner_{getpid()};
+
+    /**
+     * @brief Сохраненное имя клиента.
+     */
+    mutable Principal principal_{};
+
+    /**
+     * @brief Сохраненное имя сервера выдачи билетов. Не зависит от
+     * содержимого кеша и не сбрасывается.
+     */
+    mutable Principal server_principal_{};
+
+    /**
+     * @brief Последние прочитанные учетные данные.
+     */
+    mutable std::shared_ptr<Creds> creds_{nullptr};
+};
+
+/**
+ * @brief Поток для асинхронного выполнения операций с кешем учетных данных.
+ *
+ * Поток запускается при первой постановке задачи. При уничтожении объекта
+ * поставленные задачи выполняются до конца.
+ */
+class Worker final
+{
+public:
+    /**
+     * @brief Конструктор.
+     */
+    Worker() noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~Worker() noexcept;
+
+    /**
+     * @brief Постановка задачи в очередь.
+     *
+     * @param task Задача
+     *
+     * @return Результат постановки. При ошибке запуска потока задача не
+     * ставится в очередь.
+     */
+    bool Post(std::function<void()> task) noexcept;
+
+    /**
+     * @brief Захват блокировки очереди перед fork().
+     */
+    void ForkPrepare() noexcept;
+
+    /**
+     * @brief Освобождение блокировки очереди в родительском процессе после
+     * fork().
+     */
+    void ForkParent() noexcept;
+
+    /**
+     * @brief Сброс очереди в дочернем процессе после fork().
+     *
+     * Поток и задачи родительского процесса в дочернем не существуют; поток
+     * создается заново при следующей постановке задачи, тогда же
+     * освобождаются задачи родителя.
+     */
+    void ForkChild() noexcept;
+
+    Worker(const Worker &) = delete;
+    Worker(Worker &&) = delete;
+    Worker &operator=(const Worker &) = delete;
+    Worker &operator=(Worker &&) = delete;
+
+private:
+    /**
+     * @brief Цикл выполнения задач.
+     */
+    void Loop() noexcept;
+
+    /**
+     * @brief Блокировка очереди задач.
+     */
+    std::mutex mutex_{};
+
+    /**
+     * @brief Оповещение потока о новой задаче или остановке.
+     */
+    std::condition_variable cv_{};
+
+    /**
+     * @brief Очередь задач.
+     */
+    std::deque<std::function<void()>> tasks_{};
+
+    /**
+     * @brief Задачи родительского процесса, ожидающие освобождения после
+     * fork().
+     */
+    std::deque<std::function<void()>> abandoned_{};
+
+    /**
+     * @brief Поток выполнения задач.
+     */
+    std::thread thread_{};
+
+    /**
+     * @brief Признак остановки потока.
+     */
+    bool stop_{false};
+};
+
+/**
+ * @brief Монотонные часы для проверки сроков на частых путях.
+ *
+ * Сроки, заданные временем по системным часам, переводятся в показания
+ * монотонных часов в момент их установки, после чего проверка срока — одно
+ * чтение часов через vDSO и сравнение целых чисел. Перевод системных часов
+ * не сдвигает установленные сроки. Источник задается параметром
+ * kerberos/clock: boottime — CLOCK_BOOTTIME (по умолчанию), coarse —
+ * CLOCK_MONOTONIC_COARSE с точностью до такта ядра, monotonic —
+ * CLOCK_MONOTONIC. Только CLOCK_BOOTTIME учитывает время приостановки
+ * системы или виртуальной машины: остальные часы в это время стоят, и
+ * после возобновления сроки наступают позже истечения билета. Параметр
+ * общий для всех объектов процесса и читается при первом обращении.
+ */
+class Clock final
+{
+public:
+    /**
+     * @brief Запрос ссылки на часы процесса.
+     *
+     * @return Ссылка на часы
+     */
+    static const Clock &Instance() noexcept;
+
+    /**
+     * @brief Запрос показаний часов.
+     *
+     * @return Показания, мс
+     */
+    std::int64_t Now() const noexcept;
+
+    /**
+     * @brief Перевод времени по системным часам в показания монотонных часов.
+     *
+     * @param time Время по системным часам, 0 — срок не задан
+     *
+     * @return Показания часов в момент time, мс, или 0
+     */
+    std::int64_t Deadline(std::time_t time) const noexcept;
+
+    Clock(const Clock &) = delete;
+    Clock(Clock &&) = delete;
+    Clock &operator=(const Clock &) = delete;
+    Clock &operator=(Clock &&) = delete;
+
+private:
+    /**
+     * @brief Конструктор. Читает параметр из конфигурации.
+     */
+    Clock() noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~Clock() noexcept = default;
+
+    /**
+     * @brief Идентификатор часов clock_gettime.
+     */
+    clockid_t id_;
+};
+
+/**
+ * @brief Ограниченная экспоненциальная задержка повторных попыток обновления
+ * билета после ошибок.
+ *
+ * Параметры читаются из глобальной конфигурации:
+ * - kerberos/retry_min — задержка после первой ошибки, с (по умолчанию 5);
+ * - kerberos/retry_max — наибольшая задержка, с (по умолчанию 300);
+ * - kerberos/refresh_jitter — наибольшее случайное смещение времени фонового
+ *   обновления как доля времени действия билета (по умолчанию 0.05).
+ *
+ * Задержка удваивается после каждой ошибки подряд и содержит случайную
+ * составляющую, чтобы процессы, одновременно потерявшие связь с KDC, не
+ * обращались к нему одновременно после восстановления.
+ */
+class Backoff final
+{
+public:
+    /**
+     * @brief Конструктор. Читает параметры из конфигурации.
+     */
+    Backoff() noexcept;
+
+    /**
+     * @brief Учет успешного обновления. Сбрасывает задержку.
+     */
+    void Success() noexcept;
+
+    /**
+     * @brief Учет ошибки обновления. Увеличивает задержку.
+     *
+     * @return Задержка до следующей попытки
+     */
+    std::chrono::seconds Failure() noexcept;
+
+    /**
+     * @brief Проверка действия задержки после ошибки.
+     *
+     * @return Результат проверки
+     */
+    bool Active() const noexcept;
+
+    /**
+     * @brief Запрос времени, до которого повторные попытки не выполняются.
+     *
+     * @return Время по локальным часам или 0, если задержка не действует
+     */
+    std::time_t RetryAt() const noexcept;
+
+    /**
+     * @brief Запрос числа ошибок обновления подряд.
+     *
+     * @return Число ошибок
+     */
+    unsigned int Failures() const noexcept;
+
+    /**
+     * @brief Случайное смещение времени фонового обновления.
+     *
+     * @return Доля времени действия билета в диапазоне [0, kerberos/refresh_jitter]
+     */
+    double Jitter() noexcept;
+
+    Backoff(const Backoff &) = delete;
+    Backoff(Backoff &&) = delete;
+    Backoff &operator=(const Backoff &) = delete;
+    Backoff &operator=(Backoff &&) = delete;
+
+private:
+    /**
+     * @brief Случайное число в диапазоне [0, 1).
+     *
+     * @return Случайное число
+     */
+    double Random() noexcept;
+
+    /**
+     * @brief Задержка после первой ошибки.
+     */
+    std::chrono::seconds min_;
+
+    /**
+     * @brief Наибольшая задержка.
+     */
+    std::chrono::seconds max_;
+
+    /**
+     * @brief Наибольшее смещение времени фонового обновления.
+     */
+    double jitter_;
+
+    /**
+     * @brief Число ошибок подряд.
+     */
+    std::atomic<unsigned int> failures_{0};
+
+    /**
+     * @brief Время, до которого повторные попытки не выполняются.
+     */
+    std::atomic<std::time_t> retry_at_{0};
+
+    /**
+     * @brief Показания Clock, до которых повторные попытки не выполняются.
+     */
+    std::atomic<std::int64_t> retry_deadline_{0};
+
+    /**
+     * @brief Блокировка генератора случайных чисел.
+     */
+    std::mutex random_mutex_{};
+
+    /**
+     * @brief Генератор случайных чисел.
+     */
+    std::mt19937 random_{};
+};
+
+/**
+ * @brief Правила выбора времени и способа обновления билета.
+ *
+ * Билет обновляется заранее, до истечения: продлевается за renew_ahead до
+ * конца действия, если после продления он будет действовать не меньше
+ * min_lifetime, иначе сразу запрашивается новый билет за reinit_ahead до
+ * конца действия. Так выполняется один обмен с KDC вместо продления
+ * истекшего билета с последующим запросом нового. Окна упреждения не
+ * превышают половины времени действия билета. Параметры общие для всех
+ * объектов процесса и читаются из конфигурации при первом обращении.
+ */
+class RefreshPolicy final
+{
+public:
+    /**
+     * @brief Запрос ссылки на правила обновления процесса.
+     *
+     * @return Ссылка на правила
+     */
+    static const RefreshPolicy &Instance() noexcept;
+
+    /**
+     * @brief Определение состояния билета.
+     *
+     * @param info Времена действия билета
+     * @param now Текущее время в тех же часах, что и времена билета
+     *
+     * @return Состояние билета
+     */
+    TicketState Decide(const TicketInfo &info, std::time_t now) const noexcept;
+
+    /**
+     * @brief Выбор обмена с KDC для обновления билета без учета окон
+     * упреждения (например, для фонового обновления по доле времени).
+     *
+     * @param info Времена действия билета
+     * @param now Текущее время в тех же часах, что и времена билета
+     *
+     * @return TicketState::Renew, если продление даст билет длиннее
+     * min_lifetime, иначе TicketState::Reinit
+     */
+    TicketState Exchange(const TicketInfo &info, std::time_t now) const noexcept;
+
+    /**
+     * @brief Запрос времени, начиная с которого билет требует обновления.
+     *
+     * @param info Времена действия билета
+     *
+     * @return Время обновления в тех же часах, что и времена билета,
+     * 0 при отсутствии билета
+     */
+    std::time_t DueTime(const TicketInfo &info) const noexcept;
+
+    RefreshPolicy(const RefreshPolicy &) = delete;
+    RefreshPolicy(RefreshPolicy &&) = delete;
+    RefreshPolicy &operator=(const RefreshPolicy &) = delete;
+    RefreshPolicy &operator=(RefreshPolicy &&) = delete;
+
+private:
+    /**
+     * @brief Конструктор. Читает параметры из конфигурации.
+     */
+    RefreshPolicy() noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~RefreshPolicy() noexcept = default;
+
+    /**
+     * @brief Ограничение окна упреждения половиной времени действия билета.
+     *
+     * @param window Окно упреждения
+     * @param info Времена действия билета
+     *
+     * @return Окно упреждения, с
+     */
+    static std::time_t Window(std::time_t window, const TicketInfo &info) noexcept;
+
+    /**
+     * @brief Запрос времени, начиная с которого продление не выполняется.
+     *
+     * Общая граница для DueTime() и Exchange(): билет продлевается только
+     * строго до этого времени, иначе продленный билет был бы короче
+     * min_lifetime.
+     *
+     * @param info Времена действия билета
+     *
+     * @return Время в тех же часах, что и времена билета
+     */
+    std::time_t RenewUntil(const TicketInfo &info) const noexcept;
+
+    /**
+     * @brief Время до конца действия билета, за которое он продлевается, с.
+     */
+    std::time_t renew_ahead_;
+
+    /**
+     * @brief Время до конца действия билета, за которое запрашивается новый
+     * билет, с.
+     */
+    std::time_t reinit_ahead_;
+
+    /**
+     * @brief Наименьшее время действия продленного билета, с.
+     */
+    std::time_t min_lifetime_;
+};
+
+/**
+ * @brief Опубликованные времена действия билета.
+ *
+ * Запись выполняется одним потоком, чтение — любым числом потоков без
+ * блокировок и выделения памяти (последовательная блокировка, seqlock).
+ */
+class TicketSnapshot final
+{
+public:
+    /**
+     * @brief Публикация времен действия билета.
+     *
+     * @param start_time Время начала действия
+     * @param end_time Время конца действия
+     * @param renew_till Время, до которого можно продлевать билет
+     */
+    void Store(std::time_t start_time,
+               std::time_t end_time,
+               std::time_t renew_till) noexcept;
+
+    /**
+     * @brief Чтение времен действия билета и его состояния.
+     *
+     * @return Сведения о билете
+     */
+    TicketInfo Load() const noexcept;
+
+    /**
+     * @brief Проверка отсутствия необходимости обновления билета на текущий
+     * момент по правилам RefreshPolicy.
+     *
+     * Сравнивает показания Clock со сроком, переведенным в них при
+     * публикации, и не зависит от перевода системных часов.
+     *
+     * @return Результат проверки
+     */
+    bool Valid() const noexcept;
+
+    /**
+     * @brief Определение состояния билета по временам его действия.
+     *
+     * @param info Сведения о билете
+     * @param now Текущее время
+     *
+     * @return Состояние билета
+     */
+    static TicketState StateAt(const TicketInfo &info, std::time_t now) noexcept;
+
+private:
+    /**
+     * @brief Счетчик записей. Нечетное значение означает незавершенную запись.
+     */
+    std::atomic<unsigned int> sequence_{0};
+
+    /**
+     * @brief Время начала действия билета.
+     */
+    std::atomic<std::time_t> start_time_{0};
+
+    /**
+     * @brief Время конца действия билета.
+     */
+    std::atomic<std::time_t> end_time_{0};
+
+    /**
+     * @brief Время, до которого можно продлевать билет.
+     */
+    std::atomic<std::time_t> renew_till_{0};
+
+    /**
+     * @brief Показания Clock, начиная с которых билет требует обновления.
+     */
+    std::atomic<std::int64_t> deadline_{0};
+};
+
+/**
+ * @brief Интерфейс реализация для аутентификации Kerberos сервисом.
+ */
+class ServiceImpl final
+{
+public:
+    /**
+     * @brief Конструктор.
+     *
+     * Контекст Kerberos, таблица ключей и кеш учетных данных создаются при
+     * первом обращении или вызове Warmup.
+     *
+     * @param principal Имя клиента или пустая строка для клиента по умолчанию
+     * @param keytab Путь к таблице ключей или пустая строка для пути по
+     * умолчанию
+     * @param source Источник учетных данных
+     */
+    ServiceImpl(std::string_view principal,
+                std::string_view keytab,
+                CredsSourceType source) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~ServiceImpl() noexcept;
+
+    /**
+     * @brief Инициализация и получение билета.
+     *
+     * @return Результат получения билета
+     */
+    [[nodiscard]] bool Warmup() const noexcept;
+
+    /**
+     * @brief Инициализация и получение билета в фоновом потоке.
+     *
+     * @return Результат получения билета
+     */
+    [[nodiscard]] std::future<bool> WarmupAsync() const noexcept;
+
+    /**
+     * @brief Создание кеша учетных данных.
+     *
+     * @return Результат создания
+     */
+    [[nodiscard]] bool CreateCcache() const noexcept;
+
+    /**
+     * @brief Обновление кеша учетных данных.
+     *
+     * @return Результат обновления
+     */
+    [[nodiscard]] bool UpdateCcache() const noexcept;
+
+    /**
+     * @brief Создание кеша учетных данных с кодом и категорией ошибки.
+     *
+     * @return Результат создания
+     */
+    [[nodiscard]] Status CreateCcacheStatus() const noexcept;
+
+    /**
+     * @brief Обновление кеша учетных данных с кодом и категорией ошибки.
+     *
+     * @return Результат обновления
+     */
+    [[nodiscard]] Status UpdateCcacheStatus() const noexcept;
+
+    /**
+     * @brief Запрос результата последнего создания или обновления кеша.
+     *
+     * @return Результат последней операции
+     */
+    [[nodiscard]] Status LastStatus() const noexcept;
+
+    /**
+     * @brief Асинхронное создание кеша учетных данных.
+     *
+     * @return Результат создания
+     */
+    [[nodiscard]] std::future<bool> CreateCcacheAsync() const noexcept;
+
+    /**
+     * @brief Асинхронное создание кеша учетных данных с вызовом функции по
+     * завершении.
+     *
+     * @param callback Функция, вызываемая в потоке библиотеки с результатом
+     */
+    void CreateCcacheAsync(std::function<void(bool)> callback) const noexcept;
+
+    /**
+     * @brief Асинхронное обновление кеша учетных данных.
+     *
+     * @return Результат обновления
+     */
+    [[nodiscard]] std::future<bool> UpdateCcacheAsync() const noexcept;
+
+    /**
+     * @brief Асинхронное обновление кеша учетных данных с вызовом функции по
+     * завершении.
+     *
+     * @param callback Функция, вызываемая в потоке библиотеки с результатом
+     */
+    void UpdateCcacheAsync(std::function<void(bool)> callback) const noexcept;
+
+    /**
+     * @brief Запрос имени кеша учетных данных.
+     *
+     * @return Имя кеша
+     */
+    std::string CcacheName() const noexcept;
+
+    /**
+     * @brief Запрос сведений об опубликованном билете.
+     *
+     * @return Сведения о билете
+     */
+    TicketInfo Ticket() const noexcept;
+
+    /**
+     * @brief Запрос состояния без блокировок и обращений к KDC и файлам.
+     *
+     * @return Состояние объекта
+     */
+    HealthInfo Health() const noexcept;
+
+    /**
+     * @brief Получение билета для сервиса.
+     *
+     * @param spn Имя сервиса
+     *
+     * @return Сведения о билете сервиса
+     */
+    TicketInfo GetServiceTicket(std::string_view spn) const noexcept;
+
+    /**
+     * @brief Получение билета от имени пользователя (S4U2Self, S4U2Proxy).
+     *
+     * @param user Имя пользователя
+     * @param spn Имя сервиса или пустая строка для билета S4U2Self
+     *
+     * @return Сведения о билете
+     */
+    TicketInfo ImpersonateTicket(std::string_view user,
+                                 std::string_view spn) const noexcept;
+
+    /**
+     * @brief Формирование маркеров инициатора GSSAPI для нескольких сервисов.
+     *
+     * @param spns Имена сервисов
+     *
+     * @return Маркеры в порядке имен сервисов
+     */
+    std::vector<InitiatorToken> InitiatorTokens(
+        const std::vector<std::string> &spns) const noexcept;
+
+    /**
+     * @brief Запуск фонового упреждающего обновления кеша учетных данных.
+     *
+     * @return Результат запуска
+     */
+    [[nodiscard]] bool StartRefresher() noexcept;
+
+    /**
+     * @brief Остановка фонового обновления кеша учетных данных.
+     */
+    void StopRefresher() noexcept;
+
+    /**
+     * @brief Захват блокировок объекта перед fork().
+     *
+     * Дожидается завершения выполняемого обновления, чтобы дочерний процесс
+     * не унаследовал захваченные блокировки и незавершенную запись кеша.
+     */
+    void ForkPrepare() noexcept;
+
+    /**
+     * @brief Освобождение блокировок в родительском процессе после fork().
+     */
+    void ForkParent() noexcept;
+
+    /**
+     * @brief Подготовка объекта к работе в дочернем процессе после fork().
+     *
+     * Освобождает блокировки и отказывается от потоков родительского
+     * процесса. Контекст Kerberos, таблица ключей и кеш создаются заново при
+     * следующем обращении к объекту; полученный родительским процессом
+     * билет сохраняется и используется без обращения к KDC.
+     */
+    void ForkChild() noexcept;
+
+    ServiceImpl(const ServiceImpl &) = delete;
+    ServiceImpl(ServiceImpl &&) = delete;
+    ServiceImpl &operator=(const ServiceImpl &) = delete;
+    ServiceImpl &operator=(ServiceImpl &&) = delete;
+
+private:
+    /**
+     * @brief Однократное создание контекста Kerberos, таблицы ключей и кеша
+     * учетных данных.
+     *
+     * Повторные и одновременные вызовы дожидаются завершения первого.
+     */
+    void Init() const noexcept;
+
+    /**
+     * @brief Создание контекста Kerberos, таблицы ключей и кеша учетных
+     * данных.
+     */
+    void CreateObjects() const noexcept;
+
+    /**
+     * @brief Создание контекста Kerberos с настройками KDC объекта.
+     *
+     * Используется для основного контекста и контекстов exchange_pool_.
+     *
+     * @param context Создаваемый контекст
+     *
+     * @return Код ошибки библиотеки Kerberos
+     */
+    krb5_error_code InitContext(krb5_context *context) const noexcept;
+
+    /**
+     * @brief Пересоздание контекста Kerberos, таблицы ключей и кеша в
+     * дочернем процессе после fork().
+     */
+    void Reinit() const noexcept;
+
+    /**
+     * @brief Подготовка выбора KDC перед обменом.
+     *
+     * @param realm Область клиента
+     *
+     * @return Время начала обмена
+     */
+    std::chrono::steady_clock::time_point KdcBegin(std::string_view realm) const noexcept;
+
+    /**
+     * @brief Учет результата обмена с KDC для выбора KDC.
+     *
+     * @param start Время начала обмена
+     * @param res Результат обмена
+     */
+    void KdcEnd(std::chrono::steady_clock::time_point start, bool res) const noexcept;
+
+    /**
+     * @brief Состояние выполнения одной операции с кешем.
+     */
+    struct FlightState
+    {
+        bool (ServiceImpl::*task)() const; /*!< Операция */
+        bool active{false};                /*!< Признак выполнения */
+        unsigned long generation{0};       /*!< Номер последнего завершенного выполнения */
+        Status result{};                   /*!< Результат последнего завершенного выполнения */
+    };
+
+    /**
+     * @brief Выполнение операции с кешем учетных данных одним потоком.
+     *
+     * Если та же операция уже выполняется другим потоком, вызов дожидается
+     * ее завершения и возвращает ее результат, не выполняя обращений к KDC.
+     * Другие операции не объединяются: например, создание кеша во время
+     * обновления выполняется после него под блокировкой mutex_.
+     *
+     * @param task Операция с кешем, выполняемая под блокировкой mutex_
+     * @param fresh Не объединять с выполнением, начатым до вызова: вызов
+     * дожидается его завершения и выполняет операцию заново (например,
+     * после изменения таблицы ключей)
+     *
+     * @return Результат операции с кодом и категорией ошибки
+     */
+    Status Flight(bool (ServiceImpl::*task)() const, bool fresh = false) const noexcept;
+
+    /**
+     * @brief Поиск состояния выполнения операции.
+     *
+     * Вызывается под блокировкой flight_mutex_.
+     *
+     * @param task Операция с кешем
+     *
+     * @return Состояние выполнения
+     */
+    FlightState &FlightOf(bool (ServiceImpl::*task)() const) const noexcept;
+
+    /**
+     * @brief Выполнение операции в потоке worker_.
+     *
+     * @param call Операция
+     * @param callback Функция, вызываемая с результатом операции
+     */
+    void Async(bool (ServiceImpl::*call)() const,
+               std::function<void(bool)> callback) const noexcept;
+
+    /**
+     * @brief Создание кеша учетных данных по учетным данным источника.
+     *
+     * @return Результат создания
+     */
+    bool CreateLocked() const noexcept;
+
+    /**
+     * @brief Проверка состояния билета и его продление или повторный запрос
+     * при необходимости.
+     *
+     * @return Результат обновления
+     */
+    bool UpdateLocked() const noexcept;
+
+    /**
+     * @brief Упреждающее продление или повторный запрос билета по
+     * наступлении времени фонового обновления.
+     *
+     * @return Результат обновления
+     */
+    bool RefreshLocked() const noexcept;
+
+    /**
+     * @brief Продление билета в кеше учетных данных.
+     *
+     * @return Результат продления
+     */
+    bool RenewLocked() const noexcept;
+
+    /**
+     * @brief Получение учетных данных GSSAPI для опубликованного билета.
+     *
+     * Учетные данные создаются из опубликованного билета и билетов для
+     * сервисов в памяти повторно после публикации нового билета или
+     * сохранения билетов для сервисов.
+     *
+     * @return Учетные данные или nullptr при ошибке
+     */
+    std::shared_ptr<GssCredential> AcquireGss() const noexcept;
+
+    /**
+     * @brief Использование билета, полученного ведущим процессом.
+     *
+     * Публикации ведущего не ожидает. Ведущий процесс при первом вызове
+     * запускает фоновое обновление билета.
+     *
+     * @return true, если опубликован действующий билет и обращение к KDC не
+     * требуется; false для ведущего процесса, без общего сегмента или если
+     * ведущий процесс не обновил билет
+     */
+    bool AdoptSharedLocked() const noexcept;
+
+    /**
+     * @brief Проверка кеша учетных данных после его изменения другим
+     * процессом и повторное создание удаленного кеша.
+     *
+     * @return Результат проверки
+     */
+    bool CheckLocked() const noexcept;
+
+    /**
+     * @brief Запуск отслеживания изменений таблицы ключей и файла кеша.
+     *
+     * При замене таблицы ключей билет запрашивается повторно в потоке
+     * worker_, не дожидаясь окончания срока действия текущего билета.
+     */
+    void WatchFiles() const noexcept;
+
+    /**
+     * @brief Запрос билетов для сервисов из kerberos/service_tickets и
+     * сервисов, запрошенных за последние kerberos/service_ticket_ttl, после
+     * получения нового билета на получение билетов.
+     *
+     * Билеты остальных сервисов удаляются из памяти.
+     */
+    void FetchServiceTicketsLocked() const noexcept;
+
+    /**
+     * @brief Запрос билета для сервиса и его сохранение в памяти.
+     *
+     * @param spn Имя сервиса
+     * @param touch Отметка обращения к билету; при фоновом обновлении не
+     * выполняется, чтобы неиспользуемые билеты удалялись
+     *
+     * @return Учетные данные сервиса
+     */
+    std::shared_ptr<const Creds> FetchServiceTicketLocked(
+        const std::string &spn, bool touch) const noexcept;
+
+    /**
+     * @brief Сохранение билета для сервиса в памяти с вытеснением давно не
+     * использованных билетов сверх kerberos/service_ticket_cache.
+     *
+     * Билеты сервисов из kerberos/service_tickets не вытесняются.
+     *
+     * @param spn Имя сервиса
+     * @param creds Учетные данные сервиса
+     * @param touch Отметка обращения к билету
+     */
+    void StoreServiceTicket(const std::string &spn,
+                            std::shared_ptr<const Creds> creds,
+                            bool touch) const noexcept;
+
+    /**
+     * @brief Проверка, что билет для сервиса задан kerberos/service_tickets.
+     *
+     * @param spn Имя сервиса
+     *
+     * @return Результат проверки
+     */
+    bool ConfiguredService(const std::string &spn) const noexcept;
+
+    /**
+     * @brief Поиск действующего билета для сервиса в памяти.
+     *
+     * @param spn Имя сервиса
+     *
+     * @return Учетные данные сервиса или nullptr
+     */
+    std::shared_ptr<const Creds> CachedServiceTicket(
+        const std::string &spn) const noexcept;
+
+    /**
+     * @brief Поиск действующего билета пользователя в памяти.
+     *
+     * @param user Имя пользователя
+     * @param spn Имя сервиса или пустая строка для билета S4U2Self
+     *
+     * @return Учетные данные или nullptr
+     */
+    std::shared_ptr<const Creds> CachedImpersonation(
+        const std::string &user, const std::string &spn) const noexcept;
+
+    /**
+     * @brief Сохранение билета пользователя в памяти с учетом занимаемой
+     * памяти и вытеснением давно не использованных пользователей.
+     *
+     * @param user Имя пользователя
+     * @param spn Имя сервиса или пустая строка для билета S4U2Self
+     * @param creds Учетные данные
+     */
+    void StoreImpersonation(const std::string &user,
+                            const std::string &spn,
+                            std::shared_ptr<const Creds> creds) const noexcept;
+
+    /**
+     * @brief Получение билета пользователя у KDC на контексте из
+     * exchange_pool_ без блокировки основного контекста.
+     *
+     * Вызывается под блокировкой очереди пользователя; билеты, полученные
+     * предыдущим в очереди потоком, берутся из памяти.
+     *
+     * @param user Имя пользователя
+     * @param spn Имя сервиса или пустая строка для билета S4U2Self
+     *
+     * @return Учетные данные или nullptr при ошибке
+     */
+    std::shared_ptr<const Creds> FetchImpersonation(
+        const std::string &user, const std::string &spn) const noexcept;
+
+    /**
+     * @brief Удаление пользователей, все билеты которых истекли.
+     *
+     * Выполняется в потоке worker_ по наступлении ближайшего времени
+     * окончания действия билетов.
+     */
+    void SweepImpersonations() const noexcept;
+
+    /**
+     * @brief Учет изменения числа пользователей и занимаемой памяти в
+     * счетчиках процесса. Вызывается под impersonation_mutex_.
+     *
+     * @param entries Число пользователей до изменения
+     * @param bytes Память до изменения
+     */
+    void AccountImpersonations(std::size_t entries, std::size_t bytes) const noexcept;
+
+    /**
+     * @brief Публикация учетных данных и времени действия билета для
+     * проверки без блокировки.
+     *
+     * @param creds Учетные данные из кеша или nullptr для сброса
+     */
+    void Publish(const std::shared_ptr<Creds> &creds) const noexcept;
+
+    /**
+     * @brief Расчет времени следующего фонового обновления.
+     *
+     * @return Время обновления
+     */
+    std::chrono::system_clock::time_point NextRefresh() const noexcept;
+
+    /**
+     * @brief Цикл потока фонового обновления.
+     */
+    void RefresherLoop() noexcept;
+
+    /**
+     * Имя клиента, переданное в конструктор.
+     */
+    std::string principal_name_;
+
+    /**
+     * Путь к таблице ключей, переданный в конструктор.
+     */
+    std::string keytab_name_;
+
+    /**
+     * Источник учетных данных, переданный в конструктор.
+     */
+    CredsSourceType source_type_;
+
+    /**
+     * Признак выполненной инициализации.
+     */
+    mutable std::once_flag init_flag_{};
+
+    /**
+     * Выбор KDC. Создается в Init при заданных параметрах kerberos/kdcs,
+     * kerberos/kdc_tcp или kerberos/kdc_dns_ttl; файл его настроек читается
+     * контекстом, поэтому объект объявлен до таблицы ключей и кеша.
+     */
+    mutable std::unique_ptr<KdcRouter> kdc_{nullptr};
+
+    /**
+     * Контекст Kerberos таблицы ключей и кеша.
+     */
+    mutable std::shared_ptr<_krb5_context> context_{nullptr};
+
+    /**
+     * Контексты, созданные до fork(). Учетные данные, опубликованные
+     * родительским процессом, хранят указатель на них без владения.
+     */
+    mutable std::vector<std::shared_ptr<_krb5_context>> retired_contexts_{};
+
+    /**
+     * Признак необходимости пересоздания контекста после fork().
+     */
+    mutable std::atomic<bool> fork_pending_{false};
+
+    /**
+     * Источник начальных учетных данных (таблица ключей, сертификат или
+     * агент). Создается в Init.
+     */
+    mutable std::unique_ptr<CredsSource> source_{nullptr};
+
+    /**
+     * Структура с кешем учетных записей. Создается в Init.
+     */
+    mutable std::unique_ptr<Ccache> ccache_{nullptr};
+
+    /**
+     * Блокировка доступа к таблице ключей и кешу учетных записей. Захватывается
+     * только потоком, выполняющим обновление.
+     */
+    mutable std::mutex mutex_{};
+
+    /**
+     * Опубликованные учетные данные. Объект не изменяется после публикации,
+     * доступ выполняется через std::atomic_load/std::atomic_store.
+     */
+    mutable std::shared_ptr<const Creds> creds_{nullptr};
+
+    /**
+     * Имена сервисов, билеты для которых запрашиваются вместе с билетом на
+     * получение билетов.
+     */
+    mutable std::vector<std::string> service_spns_{};
+
+    /**
+     * Блокировка билетов для сервисов.
+     */
+    mutable std::shared_mutex tickets_mutex_{};
+
+    /**
+     * @brief Билет для сервиса в памяти.
+     */
+    struct ServiceTicket
+    {
+        std::shared_ptr<const Creds> creds{nullptr}; /*!< Учетные данные */
+        mutable std::atomic<std::int64_t> used{0};   /*!< Показания Clock при последнем обращении */
+    };
+
+    /**
+     * Билеты для сервисов по именам сервисов. Поиск выполняется под
+     * разделяемой блокировкой, время обращения обновляется атомарно.
+     */
+    mutable std::unordered_map<std::string, ServiceTicket> tickets_{};
+
+    /**
+     * Номер изменения билетов для сервисов. Учетные данные GSSAPI создаются
+     * повторно после сохранения новых билетов.
+     */
+    mutable std::atomic<std::uint64_t> tickets_generation_{0};
+
+    /**
+     * Наибольшее число билетов для сервисов в памяти, 0 — без ограничения
+     * (параметр kerberos/service_ticket_cache).
+     */
+    std::size_t ticket_capacity_;
+
+    /**
+     * Время хранения и фонового обновления билета для сервиса без
+     * обращений, мс (параметр kerberos/service_ticket_ttl).
+     */
+    std::int64_t ticket_ttl_;
+
+    /**
+     * @brief Билеты, полученные от имени пользователя.
+     */
+    struct Impersonation
+    {
+        std::shared_ptr<const Creds> evidence{nullptr}; /*!< Билет S4U2Self */
+        std::unordered_map<std::string, std::shared_ptr<const Creds>>
+            proxies{};                                   /*!< Билеты S4U2Proxy по именам сервисов */
+    };
+
+    /**
+     * @brief Очередь запросов к KDC от имени одного пользователя.
+     */
+    struct ImpersonationFlight
+    {
+        std::mutex mutex{};    /*!< Блокировка на время обмена с KDC */
+        std::size_t users{0};  /*!< Число потоков в очереди */
+    };
+
+    /**
+     * Блокировка билетов, полученных от имени пользователей, и очередей
+     * запросов.
+     */
+    mutable std::mutex impersonation_mutex_{};
+
+    /**
+     * Очереди запросов к KDC по именам пользователей. Запись существует,
+     * пока в очереди есть потоки.
+     */
+    mutable std::unordered_map<std::string, std::unique_ptr<ImpersonationFlight>>
+        impersonation_flights_{};
+
+    /**
+     * Контексты с настройками KDC объекта для получения билетов от имени
+     * пользователей вне mutex_.
+     */
+    mutable ContextPool exchange_pool_;
+
+    /**
+     * Билеты, полученные от имени пользователей, по именам пользователей.
+     * Число пользователей и занимаемая память ограничены параметрами
+     * kerberos/s4u_cache и kerberos/s4u_cache_bytes, время хранения —
+     * концом действия последнего из билетов пользователя.
+     */
+    mutable LruCache<Impersonation> impersonations_;
+
+    /**
+     * Показания Clock, по наступлении которых удаляются пользователи с
+     * истекшими билетами.
+     */
+    mutable std::atomic<std::int64_t> impersonation_sweep_{
+        std::numeric_limits<std::int64_t>::max()};
+
+    /**
+     * Общий для процессов сегмент сведений о билете. Создается в Init при
+     * kerberos/shared_cache для кеша FILE, KEYRING или KCM.
+     */
+    mutable std::unique_ptr<SharedTicket> shared_{nullptr};
+
+    /**
+     * Признак запуска фонового обновления после получения роли ведущего.
+     */
+    mutable std::atomic<bool> leader_refresher_{false};
+
+    /**
+     * @brief Учетные данные GSSAPI и билеты, из которых они созданы.
+     */
+    struct GssHandle
+    {
+        std::shared_ptr<const Creds> source{nullptr};         /*!< Билет */
+        std::uint64_t tickets{0};                             /*!< Номер изменения билетов для сервисов */
+        std::shared_ptr<GssCredential> credential{nullptr};   /*!< Учетные данные */
+    };
+
+    /**
+     * Учетные данные GSSAPI. Доступ выполняется через
+     * std::atomic_load/std::atomic_store.
+     */
+    mutable std::shared_ptr<const GssHandle> gss_{nullptr};
+
+    /**
+     * Блокировка состояния выполняемого обновления.
+     */
+    mutable std::mutex flight_mutex_{};
+
+    /**
+     * Оповещение ожидающих потоков о завершении обновления.
+     */
+    mutable std::condition_variable flight_cv_{};
+
+    /**
+     * Состояния выполнения операций с кешем, вызываемых через Flight().
+     */
+    mutable std::array<FlightState, 4> flights_{{{&ServiceImpl::CreateLocked},
+                                                 {&ServiceImpl::UpdateLocked},
+                                                 {&ServiceImpl::RefreshLocked},
+                                                 {&ServiceImpl::CheckLocked}}};
+
+    /**
+     * Результат последнего обновления, доступный без блокировки flight_mutex_.
+     */
+    mutable std::atomic<Status> status_{Status{}};
+
+    /**
+     * Времена действия опубликованного билета по локальным часам. Позволяют
+     * UpdateCcache() и Ticket() завершаться без блокировки и обращения к кешу.
+     */
+    mutable TicketSnapshot snapshot_{};
+
+    /**
+     * Доля времени действия билета, после которой выполняется фоновое
+     * обновление.
+     */
+    double refresh_ratio_{0.8};
+
+    /**
+     * Задержка повторных попыток обновления после ошибок. Пока она действует,
+     * UpdateCcache() не обращается к KDC.
+     */
+    mutable Backoff backoff_{};
+
+    /**
+     * Поток фонового обновления.
+     */
+    std::thread refresher_{};
+
+    /**
+     * Блокировка управления потоком фонового обновления.
+     */
+    std::mutex refresher_mutex_{};
+
+    /**
+     * Оповещение потока фонового обновления об остановке.
+     */
+    std::condition_variable refresher_cv_{};
+
+    /**
+     * Признак остановки потока фонового обновления.
+     */
+    bool refresher_stop_{false};
+
+    /**
+     * Признак повторного запуска фонового обновления в дочернем процессе.
      */
-    std::unique_ptr<Keytab> keytab_{nullptr};
+    mutable bool refresher_restart_{false};
 
     /**
-     * Структура с кешем учетных записей.
+     * Поток асинхронных операций. Объявлен после остальных полей, кроме
+     * watcher_, чтобы при уничтожении завершить задачи до их освобождения,
+     * но после остановки отслеживания, передающего ему операции.
      */
-    std::unique_ptr<Ccache> ccache_{nullptr};
+    mutable Worker worker_{};
 
     /**
-     * Блокировка вызова функций из разных потоков.
+     * Отслеживание изменений таблицы ключей и файла кеша. Создается в Init
+     * и объявлено последним, после worker_, чтобы поток отслеживания
+     * останавливался до разрушения worker_, которому он передает операции.
      */
-    mutable std::recursive_mutex mutex_{};
+    mutable std::unique_ptr<FileWatcher> watcher_{nullptr};
 };
 
 }  // namespace tasp::krb5
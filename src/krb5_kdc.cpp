@@ -0,0 +1,414 @@
+#include "krb5_kdc.hpp"
+
+#include "krb5_impl.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+#include <system_error>
+
+#include <arpa/nameser.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <profile.h>
+#include <resolv.h>
+#include <unistd.h>
+
+namespace fs = std::experimental::filesystem;
+
+using std::string;
+using std::string_view;
+
+namespace tasp::krb5
+{
+
+namespace
+{
+/**
+ * @brief Время, в течение которого не ответивший KDC не выбирается.
+ */
+constexpr std::time_t kKdcDownTime{60};
+
+/**
+ * @brief Вес нового измерения в сглаженном времени ответа KDC.
+ */
+constexpr double kLatencyWeight{0.3};
+
+/**
+ * @brief Размер буфера ответа DNS.
+ */
+constexpr std::size_t kAnswerSize{4096};
+
+/**
+ * @brief Создание временного файла рядом с указанным путем.
+ *
+ * @param pattern Путь, заканчивающийся на XXXXXX
+ * @param fd Дескриптор созданного файла
+ *
+ * @return Путь к созданному файлу или пустая строка при ошибке
+ */
+string MakeTemp(const string &pattern, int &fd) noexcept
+{
+    std::vector<char> buffer(pattern.begin(), pattern.end());
+    buffer.push_back('\0');
+
+    fd = mkostemp(buffer.data(), O_CLOEXEC);
+    if (fd < 0)
+    {
+        Logging::Error("Ошибка создания файла {}: {}", pattern, std::strerror(errno));
+        return {};
+    }
+
+    return string{buffer.data()};
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+KdcRouter::KdcRouter() noexcept
+: tcp_(ConfigInteger("kerberos/kdc_tcp", 0) != 0)
+, dns_ttl_(std::max(ConfigInteger("kerberos/kdc_dns_ttl", 0), 0L))
+{
+    for (auto &address : ConfigList("kerberos/kdcs"))
+    {
+        kdcs_.push_back({std::move(address)});
+    }
+    static_list_ = !kdcs_.empty();
+
+    std::error_code error{};
+    const auto directory = fs::temp_directory_path(error);
+    if (error)
+    {
+        Logging::Error("Ошибка определения каталога временных файлов: {}",
+                       error.message());
+        return;
+    }
+
+    int fd{-1};
+    const auto pattern =
+        (directory / ("tasp_krb5_" + std::to_string(getuid()) + "_XXXXXX")).string();
+    path_ = MakeTemp(pattern, fd);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (!path_.empty() && !Write())
+    {
+        unlink(path_.c_str());
+        path_.clear();
+    }
+}
+
+//------------------------------------------------------------------------------
+KdcRouter::~KdcRouter() noexcept
+{
+    if (!path_.empty() && owner_ == getpid())
+    {
+        unlink(path_.c_str());
+    }
+}
+
+//------------------------------------------------------------------------------
+bool KdcRouter::Configured() noexcept
+{
+    return ConfigInteger("kerberos/kdc_tcp", 0) != 0 ||
+           ConfigInteger("kerberos/kdc_dns_ttl", 0) > 0 ||
+           !ConfigList("kerberos/kdcs").empty();
+}
+
+//------------------------------------------------------------------------------
+krb5_error_code KdcRouter::InitContext(krb5_context *context) noexcept
+{
+    if (path_.empty())
+    {
+        return krb5_init_context(context);
+    }
+
+    char **files{nullptr};
+    auto error_code = krb5_get_default_config_files(&files);
+    if (error_code != 0)
+    {
+        return error_code;
+    }
+
+    // Файл объекта читается первым: его значения имеют приоритет, а KDC из
+    // него перечисляются раньше KDC из krb5.conf.
+    std::vector<const char *> paths{path_.c_str()};
+    for (auto **file = files; *file != nullptr; ++file)
+    {
+        paths.push_back(*file);
+    }
+    paths.push_back(nullptr);
+
+    profile_t profile{nullptr};
+    const auto profile_code = profile_init(paths.data(), &profile);
+    krb5_free_config_files(files);
+    if (profile_code != 0)
+    {
+        return static_cast<krb5_error_code>(profile_code);
+    }
+
+    error_code = krb5_init_context_profile(profile, 0, context);
+    profile_release(profile);
+
+    return error_code;
+}
+
+//------------------------------------------------------------------------------
+void KdcRouter::Prepare(string_view realm) noexcept
+{
+    if (path_.empty() || realm.empty())
+    {
+        return;
+    }
+
+    bool force{false};
+    if (realm != realm_)
+    {
+        realm_ = realm;
+        if (!static_list_)
+        {
+            kdcs_.clear();
+            resolve_at_ = 0;
+        }
+        force = true;
+    }
+
+    const auto now = std::time(nullptr);
+    if (!static_list_ && dns_ttl_.count() > 0 && now >= resolve_at_)
+    {
+        if (Resolve(realm))
+        {
+            force = true;
+        }
+        else
+        {
+            // Прежний список сохраняется до следующей попытки.
+            resolve_at_ = now + kKdcDownTime;
+        }
+    }
+
+    if (force)
+    {
+        Select(true);
+    }
+}
+
+//------------------------------------------------------------------------------
+void KdcRouter::Record(std::chrono::nanoseconds latency, ErrorCategory category) noexcept
+{
+    if (path_.empty() || kdcs_.empty())
+    {
+        return;
+    }
+
+    auto &kdc = kdcs_.at(primary_);
+    if (category == ErrorCategory::Transient)
+    {
+        kdc.down_until = std::time(nullptr) + kKdcDownTime;
+    }
+    else
+    {
+        const auto value = static_cast<double>(latency.count());
+        kdc.latency_ns = kdc.latency_ns == 0.0
+                             ? value
+                             : kdc.latency_ns + kLatencyWeight * (value - kdc.latency_ns);
+    }
+
+    Select(false);
+}
+
+//------------------------------------------------------------------------------
+bool KdcRouter::Resolve(string_view realm) noexcept
+{
+    string name{tcp_ ? "_kerberos._tcp." : "_kerberos._udp."};
+    name.append(realm);
+
+    std::array<unsigned char, kAnswerSize> answer{};
+    const int length = res_query(name.c_str(),
+                                 ns_c_in,
+                                 ns_t_srv,
+                                 answer.data(),
+                                 static_cast<int>(answer.size()));
+    if (length < 0)
+    {
+        Logging::Error("Ошибка запроса записей SRV {}", name);
+        return false;
+    }
+
+    ns_msg message{};
+    if (ns_initparse(answer.data(), length, &message) != 0)
+    {
+        Logging::Error("Ошибка разбора ответа DNS для {}", name);
+        return false;
+    }
+
+    struct Record
+    {
+        unsigned int priority;
+        unsigned int weight;
+        string address;
+    };
+    std::vector<Record> records{};
+
+    auto ttl = static_cast<std::uint32_t>(dns_ttl_.count());
+    for (int index = 0; index < ns_msg_count(message, ns_s_an); ++index)
+    {
+        ns_rr record{};
+        constexpr unsigned int kSrvFields{6};
+        if (ns_parserr(&message, ns_s_an, index, &record) != 0 ||
+            ns_rr_type(record) != ns_t_srv || ns_rr_rdlen(record) <= kSrvFields)
+        {
+            continue;
+        }
+
+        const unsigned char *rdata = ns_rr_rdata(record);
+        std::array<char, NS_MAXDNAME> target{};
+        if (dn_expand(ns_msg_base(message),
+                      ns_msg_end(message),
+                      rdata + kSrvFields,
+                      target.data(),
+                      static_cast<int>(target.size())) < 0 ||
+            target.front() == '\0' || string_view{target.data()} == ".")
+        {
+            continue;
+        }
+
+        records.push_back({ns_get16(rdata),
+                           ns_get16(rdata + 2),
+                           string{target.data()} + ":" +
+                               std::to_string(ns_get16(rdata + 4))});
+        ttl = std::min(ttl, static_cast<std::uint32_t>(ns_rr_ttl(record)));
+    }
+
+    if (records.empty())
+    {
+        Logging::Error("Записи SRV {} не найдены", name);
+        return false;
+    }
+
+    std::stable_sort(records.begin(), records.end(), [](const Record &left, const Record &right) {
+        return left.priority != right.priority ? left.priority < right.priority
+                                               : left.weight > right.weight;
+    });
+
+    // Сведения о времени ответа сохраняются для KDC, оставшихся в списке.
+    std::vector<Kdc> kdcs{};
+    for (auto &item : records)
+    {
+        const auto known = std::find_if(kdcs_.begin(), kdcs_.end(), [&item](const Kdc &kdc) {
+            return kdc.address == item.address;
+        });
+        kdcs.push_back(known != kdcs_.end() ? *known : Kdc{std::move(item.address)});
+    }
+
+    const auto primary = primary_ < kdcs_.size() ? kdcs_.at(primary_).address : string{};
+    kdcs_ = std::move(kdcs);
+
+    const auto found = std::find_if(kdcs_.begin(), kdcs_.end(), [&primary](const Kdc &kdc) {
+        return kdc.address == primary;
+    });
+    primary_ = found != kdcs_.end() ? static_cast<std::size_t>(found - kdcs_.begin()) : 0;
+
+    resolve_at_ = std::time(nullptr) + static_cast<std::time_t>(ttl);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void KdcRouter::Select(bool force) noexcept
+{
+    std::size_t best{primary_ < kdcs_.size() ? primary_ : 0};
+
+    if (!kdcs_.empty())
+    {
+        const auto now = std::time(nullptr);
+        const auto better = [now](const Kdc &left, const Kdc &right) {
+            const bool left_up = left.down_until <= now;
+            const bool right_up = right.down_until <= now;
+            if (left_up != right_up)
+            {
+                return left_up;
+            }
+            if (!left_up)
+            {
+                return left.down_until < right.down_until;
+            }
+            // Неизмеренные KDC проверяются первыми.
+            if ((left.latency_ns == 0.0) != (right.latency_ns == 0.0))
+            {
+                return left.latency_ns == 0.0;
+            }
+            return left.latency_ns < right.latency_ns;
+        };
+
+        best = static_cast<std::size_t>(
+            std::min_element(kdcs_.begin(), kdcs_.end(), better) - kdcs_.begin());
+    }
+
+    const bool changed = best != primary_;
+    if (!changed && !force)
+    {
+        return;
+    }
+
+    primary_ = best;
+    if (Write() && changed)
+    {
+        Logging::Info("Выбран KDC {} области {}", kdcs_.at(primary_).address, realm_);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool KdcRouter::Write() const noexcept
+{
+    string content{"[libdefaults]\n"};
+    if (tcp_)
+    {
+        content += "    udp_preference_limit = 1\n";
+    }
+
+    if (!realm_.empty() && !kdcs_.empty())
+    {
+        content += "[realms]\n    " + realm_ + " = {\n";
+        content += "        kdc = " + kdcs_.at(primary_).address + "\n";
+        for (std::size_t index = 0; index < kdcs_.size(); ++index)
+        {
+            if (index != primary_)
+            {
+                content += "        kdc = " + kdcs_.at(index).address + "\n";
+            }
+        }
+        content += "    }\n";
+    }
+
+    int fd{-1};
+    const auto temp = MakeTemp(path_ + ".XXXXXX", fd);
+    if (temp.empty())
+    {
+        return false;
+    }
+
+    const auto written = write(fd, content.data(), content.size());
+    const bool res = written == static_cast<ssize_t>(content.size()) && close(fd) == 0 &&
+                     std::rename(temp.c_str(), path_.c_str()) == 0;
+    if (!res)
+    {
+        Logging::Error("Ошибка записи настроек KDC {}: {}", path_, std::strerror(errno));
+        if (written != static_cast<ssize_t>(content.size()))
+        {
+            close(fd);
+        }
+        unlink(temp.c_str());
+    }
+
+    return res;
+}
+
+}  // namespace tasp::krb5
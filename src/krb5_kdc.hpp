@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Выбор KDC для обмена при обновлении билета.
+ */
+#ifndef TASP_KRB5_KDC_HPP_
+#define TASP_KRB5_KDC_HPP_
+
+#include "tasp/krb5.hpp"
+
+#include <krb5.h>
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Выбор KDC с наименьшим временем ответа.
+ *
+ * Библиотека Kerberos обращается к KDC в порядке их перечисления в
+ * настройках, поэтому объект записывает в отдельный файл настроек, который
+ * читается раньше krb5.conf, список KDC области с выбранным KDC первым, и
+ * переписывает его при смене выбора. Библиотека перечитывает измененный
+ * файл при следующем обращении к настройкам, контекст не пересоздается.
+ *
+ * Список KDC берется из параметра kerberos/kdcs или из записей SRV DNS
+ * области, которые запрашиваются не чаще, чем раз в kerberos/kdc_dns_ttl, а
+ * не при каждом обмене. Время ответа учитывается для первого в списке KDC:
+ * медленный ответ означает, что он не отвечает и билет выдан следующим.
+ * Параметр kerberos/kdc_tcp запрещает UDP, чтобы большие билеты с PAC не
+ * запрашивались повторно по TCP после ответа KRB5KRB_ERR_RESPONSE_TOO_BIG.
+ *
+ * Методы, кроме конструктора и InitContext(), вызываются под блокировкой
+ * обновления кеша ServiceImpl.
+ */
+class KdcRouter final
+{
+public:
+    /**
+     * @brief Конструктор. Читает параметры из конфигурации.
+     */
+    KdcRouter() noexcept;
+
+    /**
+     * @brief Деструктор. Удаляет файл настроек.
+     */
+    ~KdcRouter() noexcept;
+
+    /**
+     * @brief Проверка наличия параметров выбора KDC в конфигурации.
+     *
+     * @return Результат проверки
+     */
+    static bool Configured() noexcept;
+
+    /**
+     * @brief Создание контекста Kerberos, читающего файл настроек объекта
+     * перед krb5.conf.
+     *
+     * @param context Созданный контекст
+     *
+     * @return Код ошибки библиотеки Kerberos
+     */
+    krb5_error_code InitContext(krb5_context *context) noexcept;
+
+    /**
+     * @brief Подготовка списка KDC области перед обменом.
+     *
+     * Запрашивает записи SRV при смене области и по истечении времени их
+     * хранения.
+     *
+     * @param realm Область Kerberos клиента
+     */
+    void Prepare(std::string_view realm) noexcept;
+
+    /**
+     * @brief Учет результата обмена с KDC и смена выбранного KDC.
+     *
+     * @param latency Время обмена
+     * @param category Категория ошибки обмена
+     */
+    void Record(std::chrono::nanoseconds latency, ErrorCategory category) noexcept;
+
+    KdcRouter(const KdcRouter &) = delete;
+    KdcRouter(KdcRouter &&) = delete;
+    KdcRouter &operator=(const KdcRouter &) = delete;
+    KdcRouter &operator=(KdcRouter &&) = delete;
+
+private:
+    /**
+     * @brief Сведения о KDC.
+     */
+    struct Kdc
+    {
+        std::string address{};       /*!< Адрес в виде host[:port] */
+        double latency_ns{0.0};      /*!< Сглаженное время ответа, 0 — не измерено */
+        std::time_t down_until{0};   /*!< Время, до которого KDC не выбирается */
+    };
+
+    /**
+     * @brief Запрос записей SRV области.
+     *
+     * @param realm Область Kerberos
+     *
+     * @return Результат запроса
+     */
+    bool Resolve(std::string_view realm) noexcept;
+
+    /**
+     * @brief Выбор KDC и перезапись файла настроек при смене выбора.
+     *
+     * @param force Перезапись файла без смены выбора
+     */
+    void Select(bool force) noexcept;
+
+    /**
+     * @brief Запись файла настроек.
+     *
+     * @return Результат записи
+     */
+    bool Write() const noexcept;
+
+    /**
+     * Путь к файлу настроек.
+     */
+    std::string path_{};
+
+    /**
+     * Процесс, создавший файл настроек. Дочерний процесс после fork() файл
+     * не удаляет.
+     */
+    pid_t owner_{getpid()};
+
+    /**
+     * Область Kerberos, для которой составлен список KDC.
+     */
+    std::string realm_{};
+
+    /**
+     * KDC области.
+     */
+    std::vector<Kdc> kdcs_{};
+
+    /**
+     * Индекс выбранного KDC.
+     */
+    std::size_t primary_{0};
+
+    /**
+     * Признак списка KDC из конфигурации.
+     */
+    bool static_list_{false};
+
+    /**
+     * Признак запрета UDP.
+     */
+    bool tcp_{false};
+
+    /**
+     * Наибольшее время хранения записей SRV, 0 — записи не запрашиваются.
+     */
+    std::chrono::seconds dns_ttl_{0};
+
+    /**
+     * Время повторного запроса записей SRV.
+     */
+    std::time_t resolve_at_{0};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_KDC_HPP_
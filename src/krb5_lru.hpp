@@ -0,0 +1,284 @@
+/**
+ * @file
+ * @brief Ограниченный кеш с вытеснением давно не использованных записей.
+ */
+#ifndef TASP_KRB5_LRU_HPP_
+#define TASP_KRB5_LRU_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Кеш значений по строковым ключам с ограничением числа записей и
+ * занимаемой памяти.
+ *
+ * При превышении ограничений вытесняются записи, к которым дольше всего не
+ * обращались (LRU). Размер и время окончания действия записи задает
+ * владелец после ее изменения; записи с истекшим временем удаляются
+ * EvictExpired(). Записи хранятся в списке в порядке обращений, индекс
+ * ссылается на ключи в узлах списка, поэтому ключ хранится один раз. Объект
+ * не выполняет блокировок: поиск изменяет порядок записей, поэтому все
+ * вызовы выполняются под одной блокировкой владельца.
+ *
+ * @tparam Value Тип значения
+ */
+template <typename Value>
+class LruCache final
+{
+public:
+    /**
+     * @brief Конструктор.
+     *
+     * @param capacity Наибольшее число записей, 0 — без ограничения
+     * @param max_bytes Наибольший суммарный размер записей, 0 — без
+     * ограничения
+     */
+    LruCache(std::size_t capacity, std::size_t max_bytes) noexcept
+    : capacity_(capacity)
+    , max_bytes_(max_bytes)
+    {
+    }
+
+    /**
+     * @brief Поиск записи и ее перемещение в начало порядка вытеснения.
+     *
+     * @param key Ключ
+     *
+     * @return Указатель на значение или nullptr. Указатель действует до
+     * удаления записи
+     */
+    Value *Find(std::string_view key) noexcept
+    {
+        const auto found = index_.find(key);
+        if (found == index_.end())
+        {
+            return nullptr;
+        }
+
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return &found->second->value;
+    }
+
+    /**
+     * @brief Добавление записи без ограничения размера. Размер и время
+     * окончания действия задаются Charge().
+     *
+     * @param key Ключ
+     * @param value Значение
+     *
+     * @return Ссылка на значение в кеше
+     */
+    Value &Insert(std::string key, Value value) noexcept
+    {
+        auto *existing = Find(key);
+        if (existing != nullptr)
+        {
+            *existing = std::move(value);
+            return *existing;
+        }
+
+        entries_.push_front(Entry{std::move(key), std::move(value)});
+        index_.emplace(entries_.front().key, entries_.begin());
+
+        return entries_.front().value;
+    }
+
+    /**
+     * @brief Задание размера и времени окончания действия записи и
+     * вытеснение давно не использованных записей при превышении ограничений.
+     *
+     * Запись, к которой обращались последней, не вытесняется, даже если
+     * одна превышает ограничение размера.
+     *
+     * @param key Ключ
+     * @param bytes Размер записи
+     * @param expires Время окончания действия в часах владельца
+     *
+     * @return Число вытесненных записей
+     */
+    std::size_t Charge(std::string_view key, std::size_t bytes, std::int64_t expires) noexcept
+    {
+        const auto found = index_.find(key);
+        if (found != index_.end())
+        {
+            auto &entry = *found->second;
+            bytes_ = bytes_ - entry.bytes + bytes;
+            entry.bytes = bytes;
+            entry.expires = expires;
+            next_expiry_ = std::min(next_expiry_, expires);
+        }
+
+        std::size_t evicted{0};
+        while (entries_.size() > 1 &&
+               ((capacity_ > 0 && entries_.size() > capacity_) ||
+                (max_bytes_ > 0 && bytes_ > max_bytes_)))
+        {
+            Remove(std::prev(entries_.end()));
+            ++evicted;
+        }
+
+        return evicted;
+    }
+
+    /**
+     * @brief Удаление записей с истекшим временем окончания действия.
+     *
+     * @param now Текущее время в часах владельца
+     *
+     * @return Число удаленных записей
+     */
+    std::size_t EvictExpired(std::int64_t now) noexcept
+    {
+        std::size_t expired{0};
+        next_expiry_ = std::numeric_limits<std::int64_t>::max();
+
+        for (auto entry = entries_.begin(); entry != entries_.end();)
+        {
+            const auto current = entry++;
+            if (current->expires <= now)
+            {
+                Remove(current);
+                ++expired;
+            }
+            else
+            {
+                next_expiry_ = std::min(next_expiry_, current->expires);
+            }
+        }
+
+        return expired;
+    }
+
+    /**
+     * @brief Удаление записи.
+     *
+     * @param key Ключ
+     */
+    void Erase(std::string_view key) noexcept
+    {
+        const auto found = index_.find(key);
+        if (found != index_.end())
+        {
+            Remove(found->second);
+        }
+    }
+
+    /**
+     * @brief Удаление всех записей.
+     */
+    void Clear() noexcept
+    {
+        index_.clear();
+        entries_.clear();
+        bytes_ = 0;
+        next_expiry_ = std::numeric_limits<std::int64_t>::max();
+    }
+
+    /**
+     * @brief Запрос числа записей.
+     *
+     * @return Число записей
+     */
+    std::size_t Size() const noexcept
+    {
+        return entries_.size();
+    }
+
+    /**
+     * @brief Запрос суммарного размера записей.
+     *
+     * @return Размер
+     */
+    std::size_t Bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+    /**
+     * @brief Запрос ближайшего времени окончания действия записей.
+     *
+     * Значение может быть меньше действительного после удаления или
+     * изменения записей и уточняется EvictExpired().
+     *
+     * @return Время в часах владельца или наибольшее значение при
+     * отсутствии записей
+     */
+    std::int64_t NextExpiry() const noexcept
+    {
+        return next_expiry_;
+    }
+
+    LruCache(const LruCache &) = delete;
+    LruCache(LruCache &&) = delete;
+    LruCache &operator=(const LruCache &) = delete;
+    LruCache &operator=(LruCache &&) = delete;
+
+private:
+    /**
+     * @brief Запись кеша.
+     */
+    struct Entry
+    {
+        std::string key;                                          /*!< Ключ */
+        Value value;                                              /*!< Значение */
+        std::size_t bytes{0};                                     /*!< Размер */
+        std::int64_t expires{std::numeric_limits<std::int64_t>::max()}; /*!< Время окончания действия */
+    };
+
+    /**
+     * @brief Удаление записи по итератору.
+     *
+     * @param entry Итератор записи
+     */
+    void Remove(typename std::list<Entry>::iterator entry) noexcept
+    {
+        bytes_ -= entry->bytes;
+        index_.erase(entry->key);
+        entries_.erase(entry);
+    }
+
+    /**
+     * @brief Наибольшее число записей.
+     */
+    std::size_t capacity_;
+
+    /**
+     * @brief Наибольший суммарный размер записей.
+     */
+    std::size_t max_bytes_;
+
+    /**
+     * @brief Суммарный размер записей.
+     */
+    std::size_t bytes_{0};
+
+    /**
+     * @brief Ближайшее время окончания действия записей.
+     */
+    std::int64_t next_expiry_{std::numeric_limits<std::int64_t>::max()};
+
+    /**
+     * @brief Записи в порядке обращений, первая — последняя использованная.
+     */
+    std::list<Entry> entries_{};
+
+    /**
+     * @brief Индекс записей по ключам, ссылающимся на ключи в узлах списка.
+     */
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index_{};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_LRU_HPP_
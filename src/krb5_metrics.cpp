@@ -0,0 +1,187 @@
+#include "krb5_metrics.hpp"
+
+#include <algorithm>
+
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+namespace tasp::krb5
+{
+
+/*------------------------------------------------------------------------------
+    LatencyHistogram
+------------------------------------------------------------------------------*/
+void LatencyHistogram::Add(nanoseconds duration) noexcept
+{
+    const auto value = static_cast<std::uint64_t>(std::max<nanoseconds::rep>(
+        duration.count(), 0));
+
+    const auto bound = std::lower_bound(
+        Histogram::kBounds.begin(), Histogram::kBounds.end(), value);
+    const auto index =
+        static_cast<std::size_t>(bound - Histogram::kBounds.begin());
+
+    buckets_.at(index).fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(value, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+Histogram LatencyHistogram::Load() const noexcept
+{
+    Histogram histogram{};
+
+    for (std::size_t index = 0; index < buckets_.size(); ++index)
+    {
+        histogram.buckets.at(index) =
+            buckets_.at(index).load(std::memory_order_relaxed);
+    }
+    histogram.count = count_.load(std::memory_order_relaxed);
+    histogram.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+
+    return histogram;
+}
+
+/*------------------------------------------------------------------------------
+    ScopedTimer
+------------------------------------------------------------------------------*/
+ScopedTimer::ScopedTimer(LatencyHistogram &histogram) noexcept
+: histogram_(histogram)
+, start_(steady_clock::now())
+{
+}
+
+//------------------------------------------------------------------------------
+ScopedTimer::~ScopedTimer() noexcept
+{
+    histogram_.Add(steady_clock::now() - start_);
+}
+
+/*------------------------------------------------------------------------------
+    Counters
+------------------------------------------------------------------------------*/
+Counters &Counters::Instance() noexcept
+{
+    static Counters instance;
+    return instance;
+}
+
+//------------------------------------------------------------------------------
+void Counters::Increment(std::atomic<std::uint64_t> &counter) noexcept
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+void Counters::AddError(std::int32_t code) noexcept
+{
+    static_cast<void>(CountError(code));
+}
+
+//------------------------------------------------------------------------------
+bool Counters::AddError(std::int32_t code,
+                        std::chrono::nanoseconds interval,
+                        std::uint64_t &suppressed) noexcept
+{
+    const auto index = CountError(code);
+    const auto total = index < error_counts_.size()
+                           ? error_counts_.at(index).load(std::memory_order_relaxed)
+                           : errors_other_.load(std::memory_order_relaxed);
+
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+
+    auto &logged = error_logged_.at(index);
+    auto last = logged.load(std::memory_order_relaxed);
+    if (last != 0 && now - last < interval.count())
+    {
+        return false;
+    }
+
+    // Запись выполняет только поток, успевший обновить время.
+    if (!logged.compare_exchange_strong(last, now, std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    const auto reported =
+        error_reported_.at(index).exchange(total, std::memory_order_relaxed);
+    suppressed = total > reported + 1 ? total - reported - 1 : 0;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+std::size_t Counters::CountError(std::int32_t code) noexcept
+{
+    for (std::size_t index = 0; index < error_codes_.size(); ++index)
+    {
+        auto &slot = error_codes_.at(index);
+
+        std::int32_t current = slot.load(std::memory_order_relaxed);
+        if (current == 0 &&
+            slot.compare_exchange_strong(current, code, std::memory_order_relaxed))
+        {
+            // При неудаче current получает код, записанный другим потоком.
+            current = code;
+        }
+
+        if (current == code)
+        {
+            error_counts_.at(index).fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+    }
+
+    errors_other_.fetch_add(1, std::memory_order_relaxed);
+    return error_codes_.size();
+}
+
+//------------------------------------------------------------------------------
+ServiceMetrics Counters::Load() const noexcept
+{
+    ServiceMetrics metrics{};
+
+    metrics.create_calls = create_calls.load(std::memory_order_relaxed);
+    metrics.update_calls = update_calls.load(std::memory_order_relaxed);
+    metrics.update_fast = update_fast.load(std::memory_order_relaxed);
+    metrics.update_backoff = update_backoff.load(std::memory_order_relaxed);
+    metrics.flight_waits = flight_waits.load(std::memory_order_relaxed);
+    metrics.service_hits = service_hits.load(std::memory_order_relaxed);
+    metrics.service_fetches = service_fetches.load(std::memory_order_relaxed);
+    metrics.s4u_hits = s4u_hits.load(std::memory_order_relaxed);
+    metrics.s4u_fetches = s4u_fetches.load(std::memory_order_relaxed);
+    metrics.s4u_misses = s4u_misses.load(std::memory_order_relaxed);
+    metrics.s4u_evictions = s4u_evictions.load(std::memory_order_relaxed);
+    metrics.s4u_expired = s4u_expired.load(std::memory_order_relaxed);
+    metrics.s4u_entries = s4u_entries.load(std::memory_order_relaxed);
+    metrics.s4u_bytes = s4u_bytes.load(std::memory_order_relaxed);
+    metrics.shared_adopted = shared_adopted.load(std::memory_order_relaxed);
+    metrics.shared_fallbacks = shared_fallbacks.load(std::memory_order_relaxed);
+    metrics.gss_imports = gss_imports.load(std::memory_order_relaxed);
+    metrics.gss_tokens = gss_tokens.load(std::memory_order_relaxed);
+    metrics.renew_ok = renew_ok.load(std::memory_order_relaxed);
+    metrics.renew_failed = renew_failed.load(std::memory_order_relaxed);
+    metrics.reinit_ok = reinit_ok.load(std::memory_order_relaxed);
+    metrics.reinit_failed = reinit_failed.load(std::memory_order_relaxed);
+
+    metrics.create_latency = create_latency.Load();
+    metrics.update_latency = update_latency.Load();
+    metrics.kdc_latency = kdc_latency.Load();
+    metrics.lock_wait = lock_wait.Load();
+    metrics.init_latency = init_latency.Load();
+
+    for (std::size_t index = 0; index < error_codes_.size(); ++index)
+    {
+        metrics.errors.at(index).code =
+            error_codes_.at(index).load(std::memory_order_relaxed);
+        metrics.errors.at(index).count =
+            error_counts_.at(index).load(std::memory_order_relaxed);
+    }
+    metrics.errors_other = errors_other_.load(std::memory_order_relaxed);
+
+    return metrics;
+}
+
+}  // namespace tasp::krb5
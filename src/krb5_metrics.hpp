@@ -0,0 +1,220 @@
+/**
+ * @file
+ * @brief Счетчики работы библиотеки Kerberos.
+ */
+#ifndef TASP_KRB5_METRICS_HPP_
+#define TASP_KRB5_METRICS_HPP_
+
+#include "tasp/krb5.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Гистограмма времени выполнения на атомарных счетчиках.
+ */
+class LatencyHistogram final
+{
+public:
+    /**
+     * @brief Учет значения.
+     *
+     * @param duration Время выполнения
+     */
+    void Add(std::chrono::nanoseconds duration) noexcept;
+
+    /**
+     * @brief Чтение гистограммы.
+     *
+     * @return Гистограмма
+     */
+    Histogram Load() const noexcept;
+
+private:
+    /**
+     * @brief Число значений в интервалах.
+     */
+    std::array<std::atomic<std::uint64_t>, Histogram::kBounds.size() + 1>
+        buckets_{};
+
+    /**
+     * @brief Общее число значений.
+     */
+    std::atomic<std::uint64_t> count_{0};
+
+    /**
+     * @brief Сумма значений, нс.
+     */
+    std::atomic<std::uint64_t> sum_ns_{0};
+};
+
+/**
+ * @brief Замер времени выполнения блока с учетом в гистограмме.
+ */
+class ScopedTimer final
+{
+public:
+    /**
+     * @brief Конструктор. Запоминает время начала.
+     *
+     * @param histogram Гистограмма для учета
+     */
+    explicit ScopedTimer(LatencyHistogram &histogram) noexcept;
+
+    /**
+     * @brief Деструктор. Учитывает время выполнения в гистограмме.
+     */
+    ~ScopedTimer() noexcept;
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer(ScopedTimer &&) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(ScopedTimer &&) = delete;
+
+private:
+    /**
+     * @brief Гистограмма для учета.
+     */
+    LatencyHistogram &histogram_;
+
+    /**
+     * @brief Время начала.
+     */
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Счетчики работы библиотеки.
+ *
+ * Все операции выполняются над атомарными переменными с упорядочиванием
+ * relaxed и не захватывают блокировок.
+ */
+class Counters final
+{
+public:
+    /**
+     * @brief Запрос ссылки на глобальный объект счетчиков.
+     *
+     * @return Ссылка на объект счетчиков
+     */
+    static Counters &Instance() noexcept;
+
+    /**
+     * @brief Увеличение счетчика на единицу.
+     *
+     * @param counter Счетчик
+     */
+    static void Increment(std::atomic<std::uint64_t> &counter) noexcept;
+
+    /**
+     * @brief Учет ошибки библиотеки Kerberos.
+     *
+     * @param code Код ошибки
+     */
+    void AddError(std::int32_t code) noexcept;
+
+    /**
+     * @brief Учет ошибки библиотеки Kerberos с ограничением частоты записи
+     * одинаковых ошибок в лог.
+     *
+     * Ошибка с данным кодом записывается в лог не чаще одного раза за
+     * interval; ошибки, код которых не поместился в таблицу, ограничиваются
+     * вместе.
+     *
+     * @param code Код ошибки
+     * @param interval Минимальный интервал между записями в лог, ноль
+     * отключает ограничение
+     * @param suppressed Число ошибок с тем же кодом, не записанных в лог
+     * с прошлой записи
+     *
+     * @return Признак необходимости записи ошибки в лог
+     */
+    bool AddError(std::int32_t code,
+                  std::chrono::nanoseconds interval,
+                  std::uint64_t &suppressed) noexcept;
+
+    /**
+     * @brief Чтение счетчиков.
+     *
+     * @return Счетчики
+     */
+    ServiceMetrics Load() const noexcept;
+
+    std::atomic<std::uint64_t> create_calls{0};  /*!< Вызовы создания кеша */
+    std::atomic<std::uint64_t> update_calls{0};  /*!< Вызовы обновления кеша */
+    std::atomic<std::uint64_t> update_fast{0};   /*!< Обновления без блокировки */
+    std::atomic<std::uint64_t> update_backoff{0}; /*!< Обновления без KDC после ошибки */
+    std::atomic<std::uint64_t> flight_waits{0};  /*!< Ожидания обновления */
+    std::atomic<std::uint64_t> service_hits{0};  /*!< Билеты сервисов из памяти */
+    std::atomic<std::uint64_t> service_fetches{0}; /*!< Запросы билетов сервисов */
+    std::atomic<std::uint64_t> s4u_hits{0};      /*!< Билеты от имени пользователей из памяти */
+    std::atomic<std::uint64_t> s4u_fetches{0};   /*!< Запросы билетов S4U2Self и S4U2Proxy */
+    std::atomic<std::uint64_t> s4u_misses{0};    /*!< Билеты от имени пользователей не из памяти */
+    std::atomic<std::uint64_t> s4u_evictions{0}; /*!< Вытеснения пользователей по ограничениям */
+    std::atomic<std::uint64_t> s4u_expired{0};   /*!< Удаления пользователей с истекшими билетами */
+    std::atomic<std::uint64_t> s4u_entries{0};   /*!< Пользователи в памяти */
+    std::atomic<std::uint64_t> s4u_bytes{0};     /*!< Память билетов пользователей */
+    std::atomic<std::uint64_t> shared_adopted{0}; /*!< Билеты ведущего процесса */
+    std::atomic<std::uint64_t> shared_fallbacks{0}; /*!< Обновления вместо ведущего процесса */
+    std::atomic<std::uint64_t> gss_imports{0};   /*!< Создания учетных данных GSSAPI */
+    std::atomic<std::uint64_t> gss_tokens{0};    /*!< Маркеры инициатора GSSAPI */
+    std::atomic<std::uint64_t> renew_ok{0};      /*!< Успешные продления */
+    std::atomic<std::uint64_t> renew_failed{0};  /*!< Ошибки продления */
+    std::atomic<std::uint64_t> reinit_ok{0};     /*!< Успешные запросы билета */
+    std::atomic<std::uint64_t> reinit_failed{0}; /*!< Ошибки запроса билета */
+
+    LatencyHistogram create_latency{}; /*!< Время создания кеша */
+    LatencyHistogram update_latency{}; /*!< Время обновления кеша */
+    LatencyHistogram kdc_latency{};    /*!< Время обмена с KDC */
+    LatencyHistogram lock_wait{};      /*!< Время ожидания блокировки */
+    LatencyHistogram init_latency{};   /*!< Время инициализации */
+
+private:
+    /**
+     * @brief Учет ошибки в таблице кодов.
+     *
+     * @param code Код ошибки
+     *
+     * @return Индекс ячейки кода или kErrorCodes для ошибок вне таблицы
+     */
+    std::size_t CountError(std::int32_t code) noexcept;
+
+    /**
+     * @brief Коды учитываемых ошибок. Ноль означает свободную ячейку.
+     */
+    std::array<std::atomic<std::int32_t>, ServiceMetrics::kErrorCodes>
+        error_codes_{};
+
+    /**
+     * @brief Число ошибок по кодам из error_codes_.
+     */
+    std::array<std::atomic<std::uint64_t>, ServiceMetrics::kErrorCodes>
+        error_counts_{};
+
+    /**
+     * @brief Число ошибок, код которых не поместился в error_codes_.
+     */
+    std::atomic<std::uint64_t> errors_other_{0};
+
+    /**
+     * @brief Время последней записи в лог по кодам из error_codes_ и для
+     * остальных ошибок, нс монотонных часов.
+     */
+    std::array<std::atomic<std::int64_t>, ServiceMetrics::kErrorCodes + 1>
+        error_logged_{};
+
+    /**
+     * @brief Число ошибок на момент последней записи в лог.
+     */
+    std::array<std::atomic<std::uint64_t>, ServiceMetrics::kErrorCodes + 1>
+        error_reported_{};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_METRICS_HPP_
@@ -0,0 +1,122 @@
+#include "krb5_pool.hpp"
+
+#include "krb5_impl.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using std::shared_ptr;
+
+namespace tasp::krb5
+{
+
+/*------------------------------------------------------------------------------
+    ContextLease
+------------------------------------------------------------------------------*/
+ContextLease::ContextLease(ContextPool *pool,
+                           shared_ptr<_krb5_context> context) noexcept
+: pool_(pool)
+, context_(std::move(context))
+{
+}
+
+//------------------------------------------------------------------------------
+ContextLease::~ContextLease() noexcept
+{
+    if (pool_ != nullptr && context_ != nullptr)
+    {
+        pool_->Return(std::move(context_));
+    }
+}
+
+//------------------------------------------------------------------------------
+_krb5_context *ContextLease::Get() const noexcept
+{
+    return context_.get();
+}
+
+/*------------------------------------------------------------------------------
+    ContextPool
+------------------------------------------------------------------------------*/
+ContextPool &ContextPool::Instance() noexcept
+{
+    static ContextPool instance;
+    return instance;
+}
+
+//------------------------------------------------------------------------------
+ContextPool::ContextPool(ContextInit init) noexcept
+: init_(std::move(init))
+{
+    const long cores = static_cast<long>(std::thread::hardware_concurrency());
+    const long capacity = ConfigInteger("kerberos/context_pool", std::max(cores, 1L));
+
+    capacity_ = static_cast<std::size_t>(std::max(capacity, 1L));
+    free_.reserve(capacity_);
+}
+
+//------------------------------------------------------------------------------
+ContextPool::~ContextPool() noexcept = default;
+
+//------------------------------------------------------------------------------
+ContextLease ContextPool::Checkout() noexcept
+{
+    // Освобождается после снятия блокировки, при выходе из функции.
+    std::vector<shared_ptr<_krb5_context>> stale{};
+    {
+        const std::scoped_lock lock(mutex_);
+        stale.swap(stale_);
+        if (!free_.empty())
+        {
+            auto context = std::move(free_.back());
+            free_.pop_back();
+            return ContextLease{this, std::move(context)};
+        }
+    }
+
+    krb5_context context{nullptr};
+    auto error_code = init_ ? init_(&context) : krb5_init_context(&context);
+    if (error_code != 0)
+    {
+        Logging::Error("Ошибка при инициализации контекста Kerberos для пула "
+                       "(krb5_init_context)");
+        return ContextLease{this, nullptr};
+    }
+
+    return ContextLease{this, shared_ptr<_krb5_context>{context, krb5_free_context}};
+}
+
+//------------------------------------------------------------------------------
+void ContextPool::ForkPrepare() noexcept
+{
+    mutex_.lock();
+}
+
+//------------------------------------------------------------------------------
+void ContextPool::ForkParent() noexcept
+{
+    mutex_.unlock();
+}
+
+//------------------------------------------------------------------------------
+void ContextPool::ForkChild() noexcept
+{
+    // Обмен векторов не выделяет и не освобождает память.
+    stale_.swap(free_);
+    mutex_.unlock();
+}
+
+//------------------------------------------------------------------------------
+void ContextPool::Return(shared_ptr<_krb5_context> context) noexcept
+{
+    const std::scoped_lock lock(mutex_);
+    if (free_.size() < capacity_)
+    {
+        free_.push_back(std::move(context));
+    }
+}
+
+}  // namespace tasp::krb5
@@ -0,0 +1,179 @@
+/**
+ * @file
+ * @brief Пул контекстов библиотеки Kerberos.
+ */
+#ifndef TASP_KRB5_POOL_HPP_
+#define TASP_KRB5_POOL_HPP_
+
+#include <krb5.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tasp::krb5
+{
+
+class ContextPool;
+
+/**
+ * @brief Функция создания контекста для пула.
+ */
+using ContextInit = std::function<krb5_error_code(krb5_context *)>;
+
+/**
+ * @brief Контекст, выданный из пула во временное пользование.
+ *
+ * Контекст используется одним потоком и возвращается в пул при разрушении
+ * объекта.
+ */
+class ContextLease final
+{
+public:
+    /**
+     * @brief Конструктор.
+     *
+     * @param pool Пул, в который возвращается контекст
+     * @param context Контекст или nullptr при ошибке создания
+     */
+    ContextLease(ContextPool *pool,
+                 std::shared_ptr<_krb5_context> context) noexcept;
+
+    /**
+     * @brief Деструктор. Возврат контекста в пул.
+     */
+    ~ContextLease() noexcept;
+
+    /**
+     * @brief Получение указателя на контекст.
+     *
+     * @return Указатель на контекст или nullptr
+     */
+    _krb5_context *Get() const noexcept;
+
+    ContextLease(const ContextLease &) = delete;
+    ContextLease(ContextLease &&) = delete;
+    ContextLease &operator=(const ContextLease &) = delete;
+    ContextLease &operator=(ContextLease &&) = delete;
+
+private:
+    /**
+     * Пул, в который возвращается контекст.
+     */
+    ContextPool *pool_;
+
+    /**
+     * Контекст.
+     */
+    std::shared_ptr<_krb5_context> context_;
+};
+
+/**
+ * @brief Пул контекстов библиотеки Kerberos.
+ *
+ * Контекст библиотеки Kerberos не допускает одновременного использования
+ * несколькими потоками. Чтение кеша учетных данных, разбор имен и
+ * формирование сообщений об ошибках выполняются на контекстах глобального
+ * пула, не занимая основной контекст объекта аутентификации и его
+ * блокировку. Объект аутентификации держит также собственный пул
+ * контекстов, созданных с его настройками KDC, для обменов с KDC вне
+ * основной блокировки. Контексты создаются по мере необходимости; в пуле
+ * хранится не более kerberos/context_pool свободных контекстов (по
+ * умолчанию по числу ядер).
+ */
+class ContextPool final
+{
+public:
+    /**
+     * @brief Запрос ссылки на глобальный пул.
+     *
+     * @return Ссылка на пул
+     */
+    static ContextPool &Instance() noexcept;
+
+    /**
+     * @brief Конструктор.
+     *
+     * @param init Функция создания контекста или пустая функция для
+     * krb5_init_context
+     */
+    explicit ContextPool(ContextInit init = {}) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~ContextPool() noexcept;
+
+    /**
+     * @brief Получение контекста из пула или создание нового.
+     *
+     * @return Контекст во временном пользовании
+     */
+    ContextLease Checkout() noexcept;
+
+    /**
+     * @brief Захват блокировки пула перед fork().
+     */
+    void ForkPrepare() noexcept;
+
+    /**
+     * @brief Освобождение блокировки пула в родительском процессе после
+     * fork().
+     */
+    void ForkParent() noexcept;
+
+    /**
+     * @brief Отказ от свободных контекстов родительского процесса в
+     * дочернем процессе после fork().
+     *
+     * Обработчик не освобождает память: контексты освобождаются при первом
+     * получении контекста в дочернем процессе.
+     */
+    void ForkChild() noexcept;
+
+    ContextPool(const ContextPool &) = delete;
+    ContextPool(ContextPool &&) = delete;
+    ContextPool &operator=(const ContextPool &) = delete;
+    ContextPool &operator=(ContextPool &&) = delete;
+
+private:
+    friend class ContextLease;
+
+    /**
+     * @brief Возврат контекста в пул.
+     *
+     * @param context Контекст
+     */
+    void Return(std::shared_ptr<_krb5_context> context) noexcept;
+
+    /**
+     * Функция создания контекста.
+     */
+    ContextInit init_;
+
+    /**
+     * Блокировка списка свободных контекстов.
+     */
+    std::mutex mutex_{};
+
+    /**
+     * Свободные контексты.
+     */
+    std::vector<std::shared_ptr<_krb5_context>> free_{};
+
+    /**
+     * Контексты родительского процесса, ожидающие освобождения после fork().
+     */
+    std::vector<std::shared_ptr<_krb5_context>> stale_{};
+
+    /**
+     * Наибольшее число свободных контекстов.
+     */
+    std::size_t capacity_{1};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_POOL_HPP_
@@ -0,0 +1,231 @@
+#include "krb5_shared.hpp"
+
+#include "krb5_impl.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using std::string;
+using std::string_view;
+
+namespace tasp::krb5
+{
+
+namespace
+{
+/**
+ * @brief Число попыток чтения при незавершенной записи.
+ *
+ * Ограничивает ожидание, если ведущий процесс завершился во время записи.
+ */
+constexpr int kReadAttempts{1000};
+
+/**
+ * @brief Формирование имени сегмента разделяемой памяти.
+ *
+ * @param name Имя кеша учетных данных
+ *
+ * @return Имя сегмента
+ */
+string SegmentName(string_view name) noexcept
+{
+    string segment{"/tasp_krb5_" + std::to_string(getuid()) + "_"};
+    for (const char symbol : name)
+    {
+        segment.push_back(std::isalnum(static_cast<unsigned char>(symbol)) != 0
+                              ? symbol
+                              : '_');
+    }
+
+    constexpr std::size_t kMaxLength{250};
+    if (segment.size() > kMaxLength)
+    {
+        segment.erase(0, segment.size() - kMaxLength);
+        segment.front() = '/';
+    }
+
+    return segment;
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+SharedTicket::SharedTicket(string_view name) noexcept
+: name_(SegmentName(name))
+{
+    fd_ = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd_ < 0)
+    {
+        Logging::Error("Ошибка открытия общего сегмента билета {}: {}", name_,
+                       std::strerror(errno));
+        return;
+    }
+
+    if (ftruncate(fd_, static_cast<off_t>(sizeof(Segment))) != 0)
+    {
+        Logging::Error("Ошибка задания размера общего сегмента билета {}: {}",
+                       name_, std::strerror(errno));
+        return;
+    }
+
+    void *address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd_, 0);
+    if (address == MAP_FAILED)
+    {
+        Logging::Error("Ошибка отображения общего сегмента билета {}: {}", name_,
+                       std::strerror(errno));
+        return;
+    }
+
+    // Новый сегмент заполнен нулями, что соответствует неопубликованному
+    // билету; атомарные типы без блокировок не требуют инициализации.
+    segment_ = static_cast<Segment *>(address);
+
+    Logging::Info("Общий сегмент билета {}", name_);
+}
+
+//------------------------------------------------------------------------------
+SharedTicket::~SharedTicket() noexcept
+{
+    if (segment_ != nullptr)
+    {
+        munmap(segment_, sizeof(Segment));
+    }
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool SharedTicket::Mapped() const noexcept
+{
+    return segment_ != nullptr;
+}
+
+//------------------------------------------------------------------------------
+void SharedTicket::ForkChild() noexcept
+{
+    leader_.store(false, std::memory_order_relaxed);
+
+    if (fd_ < 0)
+    {
+        return;
+    }
+
+    // Закрытие унаследованного дескриптора не снимает блокировку, пока
+    // описание файла открыто в родительском процессе.
+    close(fd_);
+    fd_ = -1;
+}
+
+//------------------------------------------------------------------------------
+void SharedTicket::Reopen() noexcept
+{
+    if (fd_ >= 0 || segment_ == nullptr)
+    {
+        return;
+    }
+
+    fd_ = shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd_ < 0)
+    {
+        Logging::Error("Ошибка открытия общего сегмента билета {}: {}", name_,
+                       std::strerror(errno));
+    }
+}
+
+//------------------------------------------------------------------------------
+bool SharedTicket::Leader() noexcept
+{
+    if (leader_.load(std::memory_order_acquire) || segment_ == nullptr)
+    {
+        return leader_.load(std::memory_order_acquire);
+    }
+
+    if (fd_ < 0 || flock(fd_, LOCK_EX | LOCK_NB) != 0)
+    {
+        return false;
+    }
+
+    // Блокировка снимается ядром при завершении ведущего процесса, поэтому
+    // отдельная проверка его наличия не требуется.
+    if (leader_.exchange(true, std::memory_order_acq_rel))
+    {
+        return true;
+    }
+
+    Logging::Info("Процесс {} обновляет билет для всех процессов ({})", getpid(),
+                  name_);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void SharedTicket::Store(std::time_t start_time,
+                         std::time_t end_time,
+                         std::time_t renew_till) noexcept
+{
+    if (segment_ == nullptr || !leader_.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    auto sequence = segment_->sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1U) != 0)
+    {
+        // Запись предыдущего ведущего не была завершена.
+        ++sequence;
+    }
+
+    segment_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    segment_->start_time.store(start_time, std::memory_order_relaxed);
+    segment_->end_time.store(end_time, std::memory_order_relaxed);
+    segment_->renew_till.store(renew_till, std::memory_order_relaxed);
+
+    segment_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+TicketInfo SharedTicket::Load() const noexcept
+{
+    TicketInfo info{};
+    if (segment_ == nullptr)
+    {
+        return info;
+    }
+
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt)
+    {
+        const auto sequence = segment_->sequence.load(std::memory_order_acquire);
+
+        const auto start_time = segment_->start_time.load(std::memory_order_relaxed);
+        const auto end_time = segment_->end_time.load(std::memory_order_relaxed);
+        const auto renew_till = segment_->renew_till.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((sequence & 1U) == 0 &&
+            sequence == segment_->sequence.load(std::memory_order_relaxed))
+        {
+            info.start_time = start_time;
+            info.end_time = end_time;
+            info.renew_till = renew_till;
+            info.state = TicketSnapshot::StateAt(info, std::time(nullptr));
+            break;
+        }
+    }
+
+    return info;
+}
+
+}  // namespace tasp::krb5
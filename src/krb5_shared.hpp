@@ -0,0 +1,134 @@
+/**
+ * @file
+ * @brief Общий для процессов хоста сегмент сведений о билете.
+ */
+#ifndef TASP_KRB5_SHARED_HPP_
+#define TASP_KRB5_SHARED_HPP_
+
+#include "tasp/krb5.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Сведения о билете в разделяемой памяти для процессов, использующих
+ * один файл кеша учетных данных.
+ *
+ * Обновление билета у KDC выполняет один процесс — ведущий, удерживающий
+ * блокировку flock сегмента. После записи кеша он публикует времена
+ * действия билета (seqlock), остальные процессы читают их без блокировок и
+ * перечитывают билет из файла кеша вместо обращения к KDC. При завершении
+ * ведущего блокировка освобождается, и ведущим становится следующий
+ * процесс, которому требуется обновление.
+ */
+class SharedTicket final
+{
+public:
+    /**
+     * @brief Конструктор. Открытие или создание сегмента.
+     *
+     * @param name Имя кеша учетных данных, для которого создается сегмент
+     */
+    explicit SharedTicket(std::string_view name) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~SharedTicket() noexcept;
+
+    /**
+     * @brief Проверка доступности сегмента.
+     *
+     * @return Результат проверки
+     */
+    bool Mapped() const noexcept;
+
+    /**
+     * @brief Проверка и попытка захвата роли ведущего процесса.
+     *
+     * @return true, если процесс является ведущим
+     */
+    bool Leader() noexcept;
+
+    /**
+     * @brief Публикация времен действия билета ведущим процессом.
+     *
+     * @param start_time Время начала действия
+     * @param end_time Время конца действия
+     * @param renew_till Время, до которого можно продлевать билет
+     */
+    void Store(std::time_t start_time,
+               std::time_t end_time,
+               std::time_t renew_till) noexcept;
+
+    /**
+     * @brief Чтение опубликованных времен действия билета.
+     *
+     * @return Сведения о билете, состояние Reinit, если билет не
+     * опубликован или запись не завершена
+     */
+    TicketInfo Load() const noexcept;
+
+    /**
+     * @brief Отказ от роли ведущего в дочернем процессе после fork().
+     *
+     * Блокировка flock принадлежит описанию файла, общему с родительским
+     * процессом, поэтому унаследованный дескриптор закрывается. Новый
+     * дескриптор открывается Reopen() вне обработчика fork(); до этого
+     * процесс не может стать ведущим.
+     */
+    void ForkChild() noexcept;
+
+    /**
+     * @brief Открытие дескриптора сегмента в дочернем процессе после
+     * ForkChild().
+     */
+    void Reopen() noexcept;
+
+    SharedTicket(const SharedTicket &) = delete;
+    SharedTicket(SharedTicket &&) = delete;
+    SharedTicket &operator=(const SharedTicket &) = delete;
+    SharedTicket &operator=(SharedTicket &&) = delete;
+
+private:
+    /**
+     * @brief Содержимое сегмента.
+     */
+    struct Segment
+    {
+        std::atomic<std::uint32_t> sequence;   /*!< Счетчик записей (seqlock) */
+        std::atomic<std::int64_t> start_time;  /*!< Время начала действия */
+        std::atomic<std::int64_t> end_time;    /*!< Время конца действия */
+        std::atomic<std::int64_t> renew_till;  /*!< Время окончания продления */
+    };
+
+    /**
+     * Имя сегмента.
+     */
+    std::string name_;
+
+    /**
+     * Дескриптор сегмента, на котором удерживается блокировка ведущего.
+     */
+    int fd_{-1};
+
+    /**
+     * Отображение сегмента в память.
+     */
+    Segment *segment_{nullptr};
+
+    /**
+     * Признак роли ведущего.
+     */
+    std::atomic<bool> leader_{false};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_SHARED_HPP_
@@ -0,0 +1,338 @@
+#include "krb5_source.hpp"
+
+#include "krb5_metrics.hpp"
+
+#include "tasp/config.hpp"
+#include "tasp/logging.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::make_unique;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+
+using CMC::configGlobal;
+
+namespace tasp::krb5
+{
+
+namespace
+{
+/**
+ * @brief Наибольший размер ответа агента.
+ */
+constexpr std::size_t kAgentReplySize{4096};
+
+/**
+ * @brief Затирание строки с секретом.
+ *
+ * @param secret Строка
+ */
+void Wipe(string &secret) noexcept
+{
+    // Запись через volatile не удаляется оптимизатором.
+    volatile char *data = secret.data();
+    for (std::size_t index = 0; index < secret.size(); ++index)
+    {
+        data[index] = '\0';
+    }
+    secret.clear();
+}
+}  // namespace
+
+/*------------------------------------------------------------------------------
+    CredsSource
+------------------------------------------------------------------------------*/
+std::unique_ptr<CredsSource> CredsSource::Create(
+    const shared_ptr<_krb5_context> &context,
+    CredsSourceType type,
+    string_view fullpath,
+    string_view principal) noexcept
+{
+    if (type == CredsSourceType::Config)
+    {
+        const string name =
+            configGlobal::instance().variable("kerberos/creds_source", "keytab");
+
+        type = CredsSourceType::Keytab;
+        if (name == "pkinit")
+        {
+            type = CredsSourceType::Pkinit;
+        }
+        else if (name == "agent")
+        {
+            type = CredsSourceType::Agent;
+        }
+        else if (name != "keytab")
+        {
+            Logging::Error(
+                "Неизвестный источник учетных данных kerberos/creds_source: {}",
+                name);
+        }
+    }
+
+    switch (type)
+    {
+        case CredsSourceType::Pkinit:
+            return make_unique<Pkinit>(context, fullpath, principal);
+        case CredsSourceType::Agent:
+            return make_unique<AgentSource>(context, fullpath, principal);
+        default:
+            return make_unique<Keytab>(context, fullpath, principal);
+    }
+}
+
+/*------------------------------------------------------------------------------
+    Pkinit
+------------------------------------------------------------------------------*/
+Pkinit::Pkinit(const shared_ptr<_krb5_context> &context,
+               string_view fullpath,
+               string_view principal) noexcept
+: CredsSource(context, fullpath, principal)
+{
+    FileInterface::Init();
+
+    auto &cfg = configGlobal::instance();
+    key_ = cfg.variable("kerberos/pkinit_key", "");
+    anchors_ = cfg.variable("kerberos/pkinit_anchors", "");
+}
+
+//------------------------------------------------------------------------------
+Pkinit::~Pkinit() noexcept = default;
+
+//------------------------------------------------------------------------------
+Creds Pkinit::GetCreds(const Principal &principal) const noexcept
+{
+    const auto options = InitCredsOptions(true);
+    if (options == nullptr)
+    {
+        return Creds{};
+    }
+
+    string identity{"FILE:"};
+    identity.append(FilePath());
+    if (!key_.empty())
+    {
+        identity.append(",").append(key_);
+    }
+
+    auto error_code = krb5_get_init_creds_opt_set_pa(
+        GetContext(), options.get(), "X509_user_identity", identity.c_str());
+    if (error_code == 0 && !anchors_.empty())
+    {
+        error_code = krb5_get_init_creds_opt_set_pa(
+            GetContext(), options.get(), "X509_anchors", anchors_.c_str());
+    }
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_get_init_creds_opt_set_pa");
+        return Creds{};
+    }
+
+    krb5_creds creds{};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_init_creds_password(GetContext(),
+                                                  &creds,
+                                                  principal.Ptr(),
+                                                  nullptr,
+                                                  nullptr,
+                                                  nullptr,
+                                                  0,
+                                                  nullptr,
+                                                  options.get());
+    }
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_get_init_creds_password (PKINIT)");
+        return Creds{};
+    }
+
+    return Creds{GetContext(), creds};
+}
+
+//------------------------------------------------------------------------------
+string Pkinit::DefaultName() const noexcept
+{
+    return ConfigName();
+}
+
+//------------------------------------------------------------------------------
+string Pkinit::ConfigName() const noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    const string fullpath = cfg.variable("system/progpath");
+    return cfg.variable("kerberos/pkinit_cert", fullpath + "/client.pem");
+}
+
+/*------------------------------------------------------------------------------
+    AgentSource
+------------------------------------------------------------------------------*/
+AgentSource::AgentSource(const shared_ptr<_krb5_context> &context,
+                         string_view fullpath,
+                         string_view principal) noexcept
+: CredsSource(context, fullpath, principal)
+, timeout_(std::max(ConfigInteger("kerberos/agent_timeout", 5000), 1L))
+{
+    FileInterface::Init();
+}
+
+//------------------------------------------------------------------------------
+AgentSource::~AgentSource() noexcept = default;
+
+//------------------------------------------------------------------------------
+Creds AgentSource::GetCreds(const Principal &principal) const noexcept
+{
+    char *unparsed{nullptr};
+    auto error_code = krb5_unparse_name(GetContext(), principal.Ptr(), &unparsed);
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_unparse_name");
+        return Creds{};
+    }
+    const string name{unparsed};
+    krb5_free_unparsed_name(GetContext(), unparsed);
+
+    string password{};
+    if (!Fetch(name, password))
+    {
+        Wipe(password);
+        return Creds{};
+    }
+
+    const auto options = InitCredsOptions();
+    krb5_creds creds{};
+    {
+        const ScopedTimer timer(Counters::Instance().kdc_latency);
+        error_code = krb5_get_init_creds_password(GetContext(),
+                                                  &creds,
+                                                  principal.Ptr(),
+                                                  password.c_str(),
+                                                  nullptr,
+                                                  nullptr,
+                                                  0,
+                                                  nullptr,
+                                                  options.get());
+    }
+    Wipe(password);
+
+    if (error_code != 0)
+    {
+        PrintError(error_code, "krb5_get_init_creds_password");
+        return Creds{};
+    }
+
+    return Creds{GetContext(), creds};
+}
+
+//------------------------------------------------------------------------------
+bool AgentSource::Fetch(const string &name, string &password) const noexcept
+{
+    const string_view path{FilePath()};
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        Logging::Error("Недопустимый путь к сокету агента {}", path);
+        return false;
+    }
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        Logging::Error("Ошибка создания сокета: {}", std::strerror(errno));
+        return false;
+    }
+
+    constexpr long kMsPerSecond{1000};
+    constexpr long kUsPerMs{1000};
+    timeval timeout{};
+    timeout.tv_sec = static_cast<time_t>(timeout_.count() / kMsPerSecond);
+    timeout.tv_usec = static_cast<suseconds_t>(timeout_.count() % kMsPerSecond * kUsPerMs);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    bool res{false};
+    const string request{name + "\n"};
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        Logging::Error("Ошибка подключения к агенту {}: {}", path, std::strerror(errno));
+    }
+    else if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+             static_cast<ssize_t>(request.size()))
+    {
+        Logging::Error("Ошибка передачи запроса агенту {}: {}", path, std::strerror(errno));
+    }
+    else
+    {
+        std::array<char, kAgentReplySize> buffer{};
+        std::size_t size{0};
+        ssize_t received{0};
+        while (size < buffer.size() &&
+               (received = recv(fd, buffer.data() + size, buffer.size() - size, 0)) > 0)
+        {
+            size += static_cast<std::size_t>(received);
+        }
+
+        if (received < 0)
+        {
+            Logging::Error("Ошибка чтения ответа агента {}: {}", path, std::strerror(errno));
+        }
+        else if (size == buffer.size())
+        {
+            Logging::Error("Слишком длинный ответ агента {}", path);
+        }
+        else
+        {
+            while (size > 0 && (buffer.at(size - 1) == '\n' || buffer.at(size - 1) == '\r'))
+            {
+                --size;
+            }
+            password.assign(buffer.data(), size);
+            res = !password.empty();
+            if (!res)
+            {
+                Logging::Error("Агент {} не выдал пароль для {}", path, name);
+            }
+        }
+
+        volatile char *data = buffer.data();
+        for (std::size_t index = 0; index < buffer.size(); ++index)
+        {
+            data[index] = '\0';
+        }
+    }
+
+    close(fd);
+
+    return res;
+}
+
+//------------------------------------------------------------------------------
+string AgentSource::DefaultName() const noexcept
+{
+    return ConfigName();
+}
+
+//------------------------------------------------------------------------------
+string AgentSource::ConfigName() const noexcept
+{
+    auto &cfg = configGlobal::instance();
+
+    const string fullpath = cfg.variable("system/progpath");
+    return cfg.variable("kerberos/agent_socket", fullpath + "/krb5_agent.sock");
+}
+
+}  // namespace tasp::krb5
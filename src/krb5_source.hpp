@@ -0,0 +1,170 @@
+/**
+ * @file
+ * @brief Источники начальных учетных данных, отличные от таблицы ключей.
+ */
+#ifndef TASP_KRB5_SOURCE_HPP_
+#define TASP_KRB5_SOURCE_HPP_
+
+#include "krb5_impl.hpp"
+
+#include <krb5.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Получение билета по сертификату клиента (PKINIT).
+ *
+ * Файлом источника является сертификат клиента (kerberos/pkinit_cert),
+ * закрытый ключ читается из kerberos/pkinit_key (по умолчанию из файла
+ * сертификата), сертификаты доверенных центров — из kerberos/pkinit_anchors
+ * (по умолчанию из krb5.conf). Имя клиента задается явно или параметром
+ * kerberos/principal.
+ */
+class Pkinit final : public CredsSource
+{
+public:
+    /**
+     * @brief Конструктор.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     * @param fullpath Полный путь к сертификату или пустая строка для пути из
+     * конфигурации
+     * @param principal Имя клиента или пустая строка
+     */
+    Pkinit(const std::shared_ptr<_krb5_context> &context,
+           std::string_view fullpath,
+           std::string_view principal) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~Pkinit() noexcept override;
+
+    using CredsSource::GetCreds;
+
+    /**
+     * @brief Запрос билета у KDC по сертификату клиента.
+     *
+     * @param principal Уникальное имя клиента Kerberos
+     *
+     * @return Учетные данных Kerberos, пустые при ошибке
+     */
+    Creds GetCreds(const Principal &principal) const noexcept override;
+
+    /**
+     * @brief Полный путь к сертификату по умолчанию.
+     *
+     * @return Полный путь
+     */
+    std::string DefaultName() const noexcept override;
+
+    /**
+     * @brief Полный путь к сертификату из конфигурационного файла.
+     *
+     * @return Полный путь
+     */
+    std::string ConfigName() const noexcept override;
+
+    Pkinit(const Pkinit &) = delete;
+    Pkinit(Pkinit &&) = delete;
+    Pkinit &operator=(const Pkinit &) = delete;
+    Pkinit &operator=(Pkinit &&) = delete;
+
+private:
+    /**
+     * @brief Путь к закрытому ключу.
+     */
+    std::string key_{};
+
+    /**
+     * @brief Сертификаты доверенных центров в формате X509_anchors.
+     */
+    std::string anchors_{};
+};
+
+/**
+ * @brief Получение билета по паролю, выдаваемому внешним агентом
+ * (например, хранилищем секретов).
+ *
+ * Файлом источника является локальный сокет агента (kerberos/agent_socket).
+ * Для каждого запроса билета устанавливается соединение, агенту
+ * передается строка с именем клиента, завершенная переводом строки, и
+ * читается пароль до закрытия соединения агентом. Пароль не сохраняется
+ * и затирается в памяти после запроса билета.
+ */
+class AgentSource final : public CredsSource
+{
+public:
+    /**
+     * @brief Конструктор.
+     *
+     * @param context Главная структура библиотеки Kerberos
+     * @param fullpath Полный путь к сокету агента или пустая строка для пути
+     * из конфигурации
+     * @param principal Имя клиента или пустая строка
+     */
+    AgentSource(const std::shared_ptr<_krb5_context> &context,
+                std::string_view fullpath,
+                std::string_view principal) noexcept;
+
+    /**
+     * @brief Деструктор.
+     */
+    ~AgentSource() noexcept override;
+
+    using CredsSource::GetCreds;
+
+    /**
+     * @brief Запрос пароля у агента и билета у KDC.
+     *
+     * @param principal Уникальное имя клиента Kerberos
+     *
+     * @return Учетные данных Kerberos, пустые при ошибке
+     */
+    Creds GetCreds(const Principal &principal) const noexcept override;
+
+    /**
+     * @brief Полный путь к сокету агента по умолчанию.
+     *
+     * @return Полный путь
+     */
+    std::string DefaultName() const noexcept override;
+
+    /**
+     * @brief Полный путь к сокету агента из конфигурационного файла.
+     *
+     * @return Полный путь
+     */
+    std::string ConfigName() const noexcept override;
+
+    AgentSource(const AgentSource &) = delete;
+    AgentSource(AgentSource &&) = delete;
+    AgentSource &operator=(const AgentSource &) = delete;
+    AgentSource &operator=(AgentSource &&) = delete;
+
+private:
+    /**
+     * @brief Запрос пароля у агента.
+     *
+     * @param name Имя клиента
+     * @param password Полученный пароль
+     *
+     * @return Результат запроса
+     */
+    bool Fetch(const std::string &name, std::string &password) const noexcept;
+
+    /**
+     * @brief Наибольшее время ожидания ответа агента.
+     */
+    std::chrono::milliseconds timeout_{0};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_SOURCE_HPP_
@@ -0,0 +1,253 @@
+#include "krb5_watch.hpp"
+
+#include "krb5_impl.hpp"
+
+#include "tasp/logging.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+using std::string;
+using std::string_view;
+
+namespace tasp::krb5
+{
+
+namespace
+{
+/**
+ * @brief События каталога, означающие изменение, удаление или замену файла.
+ */
+constexpr std::uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                     IN_MOVED_FROM | IN_DELETE | IN_CREATE |
+                                     IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+}  // namespace
+
+//------------------------------------------------------------------------------
+FileWatcher::FileWatcher() noexcept
+: inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+, stop_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (inotify_fd_ < 0 || stop_fd_ < 0)
+    {
+        Logging::Error("Ошибка создания отслеживания файлов: {}",
+                       std::strerror(errno));
+    }
+}
+
+//------------------------------------------------------------------------------
+FileWatcher::~FileWatcher() noexcept
+{
+    if (thread_.joinable())
+    {
+        const std::uint64_t value{1};
+        static_cast<void>(write(stop_fd_, &value, sizeof(value)));
+        thread_.join();
+    }
+
+    if (stop_fd_ >= 0)
+    {
+        close(stop_fd_);
+    }
+
+    if (inotify_fd_ >= 0)
+    {
+        close(inotify_fd_);
+    }
+}
+
+//------------------------------------------------------------------------------
+void FileWatcher::ForkChild() noexcept
+{
+    AbandonThread(thread_);
+}
+
+//------------------------------------------------------------------------------
+bool FileWatcher::Watch(string_view path,
+                        std::atomic<bool> *changed,
+                        std::atomic<bool> *watched,
+                        std::function<void()> callback) noexcept
+{
+    if (inotify_fd_ < 0 || stop_fd_ < 0 || path.empty() || path.front() != '/')
+    {
+        return false;
+    }
+
+    const auto separator = path.rfind('/');
+    const string directory{separator == 0 ? string_view{"/"}
+                                          : path.substr(0, separator)};
+    const string name{path.substr(separator + 1)};
+
+    const int descriptor = inotify_add_watch(inotify_fd_, directory.c_str(), kWatchMask);
+    if (descriptor < 0)
+    {
+        Logging::Error("Ошибка отслеживания каталога {}: {}", directory,
+                       std::strerror(errno));
+        return false;
+    }
+
+    const std::scoped_lock lock(mutex_);
+
+    try
+    {
+        targets_.push_back(
+            Target{descriptor, name, changed, watched, std::move(callback), false});
+
+        if (!thread_.joinable())
+        {
+            thread_ = std::thread(&FileWatcher::Loop, this);
+        }
+    }
+    catch (const std::exception &error)
+    {
+        Logging::Error("Ошибка запуска отслеживания файлов ({})", error.what());
+        return false;
+    }
+
+    watched->store(true, std::memory_order_release);
+    Logging::Info("Отслеживание изменений файла {}", path);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void FileWatcher::Loop() noexcept
+{
+    std::array<pollfd, 2> fds{};
+    fds[0].fd = inotify_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_fd_;
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        const int res = poll(fds.data(), fds.size(), -1);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if ((fds[1].revents & POLLIN) != 0)
+        {
+            return;
+        }
+
+        if ((fds[0].revents & POLLIN) != 0 && !ReadEvents())
+        {
+            break;
+        }
+    }
+
+    Logging::Error("Отслеживание изменений файлов прекращено: {}",
+                   std::strerror(errno));
+    Notify(-1, {}, true);
+}
+
+//------------------------------------------------------------------------------
+bool FileWatcher::ReadEvents() noexcept
+{
+    alignas(inotify_event) std::array<char, 4096> buffer{};
+
+    while (true)
+    {
+        const ssize_t length = read(inotify_fd_, buffer.data(), buffer.size());
+        if (length < 0)
+        {
+            // код ошибки сохраняется до вызова функций обработки, которые
+            // могут его изменить; он же выводится в журнал в Loop().
+            const int error = errno;
+            if (error == EINTR)
+            {
+                continue;
+            }
+
+            Dispatch();
+            errno = error;
+            return error == EAGAIN;
+        }
+
+        for (ssize_t offset = 0; offset < length;)
+        {
+            inotify_event event{};
+            std::memcpy(&event, buffer.data() + offset, sizeof(event));
+            const char *name = buffer.data() + offset +
+                               static_cast<ssize_t>(sizeof(inotify_event));
+
+            if ((event.mask & IN_Q_OVERFLOW) != 0)
+            {
+                Notify(-1, {}, false);
+            }
+            else if ((event.mask & IN_IGNORED) != 0)
+            {
+                Notify(event.wd, {}, true);
+            }
+            else
+            {
+                Notify(event.wd, event.len > 0 ? string_view{name} : string_view{},
+                       false);
+            }
+
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event.len);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void FileWatcher::Notify(int descriptor, string_view name, bool lost) noexcept
+{
+    const std::scoped_lock lock(mutex_);
+    for (auto &target : targets_)
+    {
+        if (descriptor >= 0 &&
+            (target.descriptor != descriptor ||
+             (!name.empty() && target.name != name)))
+        {
+            continue;
+        }
+
+        if (lost)
+        {
+            target.watched->store(false, std::memory_order_release);
+        }
+        else
+        {
+            target.pending = true;
+        }
+        target.changed->store(true, std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------------------------
+void FileWatcher::Dispatch() noexcept
+{
+    std::vector<std::function<void()>> callbacks;
+    {
+        const std::scoped_lock lock(mutex_);
+        for (auto &target : targets_)
+        {
+            if (target.pending && target.callback)
+            {
+                callbacks.push_back(target.callback);
+            }
+            target.pending = false;
+        }
+    }
+
+    for (const auto &callback : callbacks)
+    {
+        callback();
+    }
+}
+
+}  // namespace tasp::krb5
@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @brief Отслеживание изменений файлов Kerberos.
+ */
+#ifndef TASP_KRB5_WATCH_HPP_
+#define TASP_KRB5_WATCH_HPP_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace tasp::krb5
+{
+
+/**
+ * @brief Отслеживание изменений файлов с помощью inotify.
+ *
+ * Отслеживаются каталоги файлов, поэтому обнаруживаются как изменение файла,
+ * так и его удаление или замена переименованием. При изменении файла
+ * устанавливается признак изменения и вызывается функция обработки. При
+ * переполнении очереди событий признак устанавливается для всех файлов, при
+ * потере отслеживания каталога сбрасывается признак отслеживания, и
+ * проверка файла выполняется по stat.
+ */
+class FileWatcher final
+{
+public:
+    /**
+     * @brief Конструктор.
+     */
+    FileWatcher() noexcept;
+
+    /**
+     * @brief Деструктор. Остановка потока отслеживания.
+     */
+    ~FileWatcher() noexcept;
+
+    /**
+     * @brief Добавление файла для отслеживания.
+     *
+     * @param path Абсолютный путь к файлу
+     * @param changed Признак изменения файла
+     * @param watched Признак отслеживания файла
+     * @param callback Функция, вызываемая потоком отслеживания при изменении
+     * файла
+     *
+     * @return Результат добавления
+     */
+    bool Watch(std::string_view path,
+               std::atomic<bool> *changed,
+               std::atomic<bool> *watched,
+               std::function<void()> callback) noexcept;
+
+    /**
+     * @brief Отказ от потока отслеживания в дочернем процессе после fork().
+     *
+     * Поток родительского процесса в дочернем не существует; после вызова
+     * объект только освобождает дескрипторы при разрушении.
+     */
+    void ForkChild() noexcept;
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher(FileWatcher &&) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+    FileWatcher &operator=(FileWatcher &&) = delete;
+
+private:
+    /**
+     * @brief Отслеживаемый файл.
+     */
+    struct Target
+    {
+        int descriptor{-1};                   /*!< Дескриптор отслеживания каталога */
+        std::string name{};                   /*!< Имя файла в каталоге */
+        std::atomic<bool> *changed{nullptr};  /*!< Признак изменения */
+        std::atomic<bool> *watched{nullptr};  /*!< Признак отслеживания */
+        std::function<void()> callback{};     /*!< Функция обработки */
+        bool pending{false};                  /*!< Изменение еще не обработано */
+    };
+
+    /**
+     * @brief Цикл потока отслеживания.
+     */
+    void Loop() noexcept;
+
+    /**
+     * @brief Чтение и обработка накопленных событий.
+     *
+     * @return false, если чтение событий невозможно
+     */
+    bool ReadEvents() noexcept;
+
+    /**
+     * @brief Отметка файлов как измененных.
+     *
+     * @param descriptor Дескриптор каталога или -1 для всех файлов
+     * @param name Имя файла или пустая строка для всех файлов каталога
+     * @param lost Признак потери отслеживания каталога. Функция обработки
+     * в этом случае не вызывается
+     */
+    void Notify(int descriptor, std::string_view name, bool lost) noexcept;
+
+    /**
+     * @brief Однократный вызов функций обработки для файлов, измененных с
+     * предыдущего вызова.
+     *
+     * Несколько событий одной записи или замены файла приводят к одному
+     * вызову функции обработки.
+     */
+    void Dispatch() noexcept;
+
+    /**
+     * Дескриптор inotify.
+     */
+    int inotify_fd_{-1};
+
+    /**
+     * Дескриптор для остановки потока.
+     */
+    int stop_fd_{-1};
+
+    /**
+     * Блокировка списка файлов.
+     */
+    std::mutex mutex_{};
+
+    /**
+     * Отслеживаемые файлы.
+     */
+    std::vector<Target> targets_{};
+
+    /**
+     * Поток отслеживания. Запускается при добавлении первого файла.
+     */
+    std::thread thread_{};
+};
+
+}  // namespace tasp::krb5
+
+#endif  // TASP_KRB5_WATCH_HPP_
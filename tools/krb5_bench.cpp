@@ -0,0 +1,720 @@
+/**
+ * @file
+ * @brief Измерение затрат Service::UpdateCcache() и Service::CreateCcache()
+ * для кешей учетных данных FILE и MEMORY.
+ *
+ * Для каждого типа кеша программа запускает дочерний процесс с KRB5CCNAME,
+ * указывающим на кеш этого типа, получает билет и выполняет тесты:
+ *
+ * - update — UpdateCcache() в одном потоке;
+ * - update_mt — UpdateCcache() в нескольких потоках (конкуренция на пути
+ *   без блокировки);
+ * - create — CreateCcache() в одном потоке (запрос нового билета);
+ * - create_mt — CreateCcache() в нескольких потоках (конкуренция на пути с
+ *   блокировкой и обменом с KDC);
+ * - renew — UpdateCcache() по наступлении срока продления билета (при
+ *   заданном -r; требует коротких kerberos/ticket_lifetime и
+ *   kerberos/renew_lifetime).
+ *
+ * Для каждого теста выводятся время, число выделений памяти (malloc,
+ * calloc и realloc, в том числе внутри libkrb5 и operator new) и число
+ * системных вызовов на операцию, затем отношение
+ * значений MEMORY к FILE. Выделения и системные вызовы считаются в каждом
+ * потоке теста от начала до конца его цикла, поэтому создание и завершение
+ * потоков в результат не входят.
+ *
+ * Если библиотека использует кеш другого типа (system/type отличен от
+ * manual, и тип задает kerberos/ccache_type), программа завершается с
+ * ошибкой, не выводя результатов.
+ *
+ * Использование: tasp-krb5-bench [-t потоков] [-n операций] [-c созданий]
+ * [-r продлений] [-w секунд] [-d каталог]
+ */
+#include "tasp/krb5.hpp"
+
+#include <linux/perf_event.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using tasp::krb5::Service;
+using tasp::krb5::ServiceMetrics;
+using tasp::krb5::TicketState;
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *memory, std::size_t size);
+void __libc_free(void *memory);
+}
+
+namespace
+{
+/**
+ * @brief Число выделений памяти в текущем потоке.
+ */
+thread_local std::uint64_t allocations{0};
+}  // namespace
+
+/*------------------------------------------------------------------------------
+    Замена функций выделения памяти библиотеки C для подсчета выделений.
+    Через них выделяют память libkrb5, libgssapi_krb5 и operator new
+    библиотеки C++, поэтому учитываются выделения всех библиотек.
+------------------------------------------------------------------------------*/
+extern "C" [[gnu::visibility("default")]] void *malloc(std::size_t size) noexcept
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+//------------------------------------------------------------------------------
+extern "C" [[gnu::visibility("default")]] void *calloc(std::size_t count, std::size_t size) noexcept
+{
+    ++allocations;
+    return __libc_calloc(count, size);
+}
+
+//------------------------------------------------------------------------------
+extern "C" [[gnu::visibility("default")]] void *realloc(void *memory, std::size_t size) noexcept
+{
+    ++allocations;
+    return __libc_realloc(memory, size);
+}
+
+//------------------------------------------------------------------------------
+extern "C" [[gnu::visibility("default")]] void free(void *memory) noexcept
+{
+    __libc_free(memory);
+}
+
+namespace
+{
+/**
+ * @brief Параметры запуска.
+ */
+struct Options
+{
+    unsigned threads{std::thread::hardware_concurrency()}; /*!< Число потоков многопоточных тестов */
+    std::uint64_t updates{1'000'000}; /*!< Число вызовов UpdateCcache() в потоке */
+    std::uint64_t creates{10};        /*!< Число вызовов CreateCcache() в потоке */
+    std::uint64_t renews{0};          /*!< Число продлений билета */
+    std::int64_t renew_wait{600};     /*!< Наибольшее ожидание срока продления, с */
+    string directory{"/tmp"};         /*!< Каталог файлового кеша */
+};
+
+/**
+ * @brief Результат теста, передаваемый из дочернего процесса.
+ */
+struct Result
+{
+    char type[8]{};          /*!< Тип кеша */
+    char test[16]{};         /*!< Имя теста */
+    bool ok{false};          /*!< Все вызовы завершились успешно */
+    unsigned threads{0};     /*!< Число потоков */
+    std::uint64_t ops{0};    /*!< Общее число операций */
+    double ns{0};            /*!< Среднее время операции, нс */
+    double allocs{0};        /*!< Выделений памяти (malloc, calloc, realloc) на операцию */
+    double syscalls{0};      /*!< Системных вызовов на операцию */
+    std::uint64_t flight_waits{0}; /*!< Ожидания обновления другим потоком */
+    std::uint64_t lock_wait_ns{0}; /*!< Суммарное ожидание блокировки, нс */
+};
+
+/*------------------------------------------------------------------------------
+    SyscallCounter
+------------------------------------------------------------------------------*/
+/**
+ * @brief Счетчик системных вызовов текущего потока.
+ *
+ * Используется точка трассировки raw_syscalls:sys_enter через
+ * perf_event_open (требует kernel.perf_event_paranoid = -1 или
+ * CAP_PERFMON). Если она недоступна, считаются только вызовы чтения и
+ * записи из /proc/thread-self/io (syscr, syscw). Вызовы самого счетчика
+ * исключаются из результата.
+ */
+class SyscallCounter final
+{
+public:
+    /**
+     * @brief Конструктор. Должен вызываться в измеряемом потоке.
+     *
+     * @param tracepoint Идентификатор точки трассировки или -1
+     */
+    explicit SyscallCounter(long tracepoint) noexcept
+    {
+        if (tracepoint >= 0)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.config = static_cast<std::uint64_t>(tracepoint);
+
+            fd_ = static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+
+        const auto first = Read();
+        overhead_ = Read() - first;
+    }
+
+    /**
+     * @brief Деструктор.
+     */
+    ~SyscallCounter() noexcept
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    /**
+     * @brief Запуск подсчета.
+     */
+    void Start() noexcept
+    {
+        start_ = Read();
+    }
+
+    /**
+     * @brief Запрос числа системных вызовов с момента Start().
+     *
+     * @return Число вызовов
+     */
+    std::uint64_t Stop() const noexcept
+    {
+        const auto count = Read() - start_;
+        return count > overhead_ ? count - overhead_ : 0;
+    }
+
+    /**
+     * @brief Запрос идентификатора точки трассировки raw_syscalls:sys_enter.
+     *
+     * @return Идентификатор или -1, если точка недоступна
+     */
+    static long Tracepoint() noexcept
+    {
+        for (const char *path : {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                                 "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"})
+        {
+            std::FILE *file = std::fopen(path, "r");
+            if (file == nullptr)
+            {
+                continue;
+            }
+
+            long id{-1};
+            const int parsed = std::fscanf(file, "%ld", &id);
+            std::fclose(file);
+            if (parsed == 1)
+            {
+                return Available(id) ? id : -1;
+            }
+        }
+
+        return -1;
+    }
+
+    SyscallCounter(const SyscallCounter &) = delete;
+    SyscallCounter(SyscallCounter &&) = delete;
+    SyscallCounter &operator=(const SyscallCounter &) = delete;
+    SyscallCounter &operator=(SyscallCounter &&) = delete;
+
+private:
+    /**
+     * @brief Проверка доступа к точке трассировки.
+     *
+     * @param id Идентификатор точки трассировки
+     *
+     * @return Результат проверки
+     */
+    static bool Available(long id) noexcept
+    {
+        const SyscallCounter counter(id);
+        return counter.fd_ >= 0;
+    }
+
+    /**
+     * @brief Чтение текущего значения счетчика.
+     *
+     * @return Значение
+     */
+    std::uint64_t Read() const noexcept
+    {
+        if (fd_ >= 0)
+        {
+            std::uint64_t value{0};
+            return read(fd_, &value, sizeof(value)) == sizeof(value) ? value : 0;
+        }
+
+        const int fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return 0;
+        }
+
+        char buffer[512]{};
+        const auto size = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (size <= 0)
+        {
+            return 0;
+        }
+
+        std::uint64_t value{0};
+        for (const char *field : {"syscr:", "syscw:"})
+        {
+            const char *found = std::strstr(buffer, field);
+            if (found != nullptr)
+            {
+                value += std::strtoull(found + std::strlen(field), nullptr, 10);
+            }
+        }
+
+        return value;
+    }
+
+    /**
+     * @brief Дескриптор счетчика perf или -1 при чтении /proc.
+     */
+    int fd_{-1};
+
+    /**
+     * @brief Число вызовов, выполняемых самим счетчиком при чтении.
+     */
+    std::uint64_t overhead_{0};
+
+    /**
+     * @brief Значение счетчика при запуске подсчета.
+     */
+    std::uint64_t start_{0};
+};
+
+/**
+ * @brief Затраты одного потока теста.
+ */
+struct ThreadCost
+{
+    bool ok{true};               /*!< Все вызовы завершились успешно */
+    std::uint64_t ns{0};         /*!< Время цикла, нс */
+    std::uint64_t allocs{0};     /*!< Выделения памяти */
+    std::uint64_t syscalls{0};   /*!< Системные вызовы */
+};
+
+//------------------------------------------------------------------------------
+void Copy(char *target, std::size_t size, const char *source) noexcept
+{
+    std::snprintf(target, size, "%s", source);
+}
+
+/**
+ * @brief Выполнение теста.
+ *
+ * Потоки ожидают общего запуска, после чего каждый выполняет iterations
+ * вызовов operation и суммирует собственные затраты.
+ *
+ * @param type Тип кеша
+ * @param test Имя теста
+ * @param threads Число потоков
+ * @param iterations Число вызовов в потоке
+ * @param operation Проверяемая операция
+ *
+ * @return Результат теста
+ */
+template <typename Operation>
+Result Run(const char *type,
+           const char *test,
+           unsigned threads,
+           std::uint64_t iterations,
+           Operation operation) noexcept
+{
+    static const long tracepoint = SyscallCounter::Tracepoint();
+
+    std::vector<ThreadCost> costs(threads);
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> start{false};
+
+    const ServiceMetrics before = Service::Metrics();
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (unsigned index = 0; index < threads; ++index)
+    {
+        pool.emplace_back([&, index]() noexcept {
+            auto &cost = costs[index];
+            SyscallCounter counter(tracepoint);
+
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            const auto allocs = allocations;
+            counter.Start();
+            const auto begin = std::chrono::steady_clock::now();
+
+            bool ok{true};
+            for (std::uint64_t call = 0; call < iterations; ++call)
+            {
+                ok = operation() && ok;
+            }
+
+            const auto end = std::chrono::steady_clock::now();
+            cost.ok = ok;
+            cost.syscalls = counter.Stop();
+            cost.allocs = allocations - allocs;
+            cost.ns = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        });
+    }
+
+    while (ready.load() < threads)
+    {
+        std::this_thread::yield();
+    }
+    start.store(true, std::memory_order_release);
+
+    for (auto &thread : pool)
+    {
+        thread.join();
+    }
+
+    const ServiceMetrics after = Service::Metrics();
+
+    Result result;
+    Copy(result.type, sizeof(result.type), type);
+    Copy(result.test, sizeof(result.test), test);
+    result.ok = true;
+    result.threads = threads;
+    result.ops = threads * iterations;
+    result.flight_waits = after.flight_waits - before.flight_waits;
+    result.lock_wait_ns = after.lock_wait.sum_ns - before.lock_wait.sum_ns;
+
+    std::uint64_t ns{0};
+    std::uint64_t allocs{0};
+    std::uint64_t syscalls{0};
+    for (const auto &cost : costs)
+    {
+        result.ok = result.ok && cost.ok;
+        ns += cost.ns;
+        allocs += cost.allocs;
+        syscalls += cost.syscalls;
+    }
+
+    const auto ops = static_cast<double>(result.ops == 0 ? 1 : result.ops);
+    result.ns = static_cast<double>(ns) / ops;
+    result.allocs = static_cast<double>(allocs) / ops;
+    result.syscalls = static_cast<double>(syscalls) / ops;
+
+    return result;
+}
+
+/**
+ * @brief Выполнение теста продления билета.
+ *
+ * Перед каждым вызовом UpdateCcache() ожидается наступление срока
+ * продления; учитываются только затраты самого вызова. Тест успешен, если
+ * каждый вызов продлил билет (renew_ok).
+ *
+ * @param type Тип кеша
+ * @param renews Число продлений
+ * @param wait_s Наибольшее ожидание срока продления, с
+ *
+ * @return Результат теста
+ */
+Result RunRenew(const char *type, std::uint64_t renews, std::int64_t wait_s) noexcept
+{
+    const auto &service = Service::Instance();
+    SyscallCounter counter(SyscallCounter::Tracepoint());
+
+    const ServiceMetrics before = Service::Metrics();
+
+    Result result;
+    Copy(result.type, sizeof(result.type), type);
+    Copy(result.test, sizeof(result.test), "renew");
+    result.ok = true;
+    result.threads = 1;
+
+    std::uint64_t ns{0};
+    std::uint64_t allocs{0};
+    std::uint64_t syscalls{0};
+    for (std::uint64_t renew = 0; renew < renews && result.ok; ++renew)
+    {
+        const auto deadline = std::time(nullptr) + wait_s;
+        while (service.Ticket().state == TicketState::None && std::time(nullptr) < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+
+        if (service.Ticket().state != TicketState::Renew)
+        {
+            std::fprintf(stderr, "%s: срок продления билета не наступил\n", type);
+            result.ok = false;
+            break;
+        }
+
+        const auto start_allocs = allocations;
+        counter.Start();
+        const auto begin = std::chrono::steady_clock::now();
+
+        result.ok = service.UpdateCcache();
+
+        const auto end = std::chrono::steady_clock::now();
+        syscalls += counter.Stop();
+        allocs += allocations - start_allocs;
+        ns += static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        ++result.ops;
+    }
+
+    const ServiceMetrics after = Service::Metrics();
+    result.ok = result.ok && after.renew_ok - before.renew_ok == result.ops;
+    result.flight_waits = after.flight_waits - before.flight_waits;
+    result.lock_wait_ns = after.lock_wait.sum_ns - before.lock_wait.sum_ns;
+
+    const auto ops = static_cast<double>(result.ops == 0 ? 1 : result.ops);
+    result.ns = static_cast<double>(ns) / ops;
+    result.allocs = static_cast<double>(allocs) / ops;
+    result.syscalls = static_cast<double>(syscalls) / ops;
+
+    return result;
+}
+
+/**
+ * @brief Выполнение тестов для одного типа кеша в дочернем процессе.
+ *
+ * @param type Тип кеша (FILE, MEMORY)
+ * @param options Параметры запуска
+ * @param output Дескриптор канала для передачи результатов
+ *
+ * @return Код завершения процесса
+ */
+int RunType(const char *type, const Options &options, int output) noexcept
+{
+    const string path = options.directory + "/tasp_krb5_bench_" + std::to_string(getpid());
+    const string name = string(type) == "FILE" ? "FILE:" + path : "MEMORY:tasp_krb5_bench";
+    setenv("KRB5CCNAME", name.c_str(), 1);
+
+    const auto &service = Service::Instance();
+    if (!service.CreateCcache())
+    {
+        std::fprintf(stderr, "%s: ошибка получения билета\n", type);
+        return EXIT_FAILURE;
+    }
+
+    const string actual = service.CcacheName();
+    if (actual.rfind(string(type) + ":", 0) != 0 &&
+        !(string(type) == "FILE" && actual.find(':') == string::npos))
+    {
+        std::fprintf(stderr,
+                     "%s: используется кеш %s (тип задается kerberos/ccache_type "
+                     "при system/type, отличном от manual)\n",
+                     type,
+                     actual.c_str());
+        return EXIT_FAILURE;
+    }
+
+    const auto update = [&service]() noexcept { return service.UpdateCcache(); };
+    const auto create = [&service]() noexcept { return service.CreateCcache(); };
+
+    std::vector<Result> results{
+        Run(type, "update", 1, options.updates, update),
+        Run(type, "update_mt", options.threads, options.updates, update),
+        Run(type, "create", 1, options.creates, create),
+        Run(type, "create_mt", options.threads, options.creates, create),
+    };
+
+    if (options.renews > 0)
+    {
+        results.push_back(RunRenew(type, options.renews, options.renew_wait));
+    }
+
+    if (string(type) == "FILE")
+    {
+        unlink(path.c_str());
+    }
+
+    const auto size = static_cast<ssize_t>(results.size() * sizeof(Result));
+    return write(output, results.data(), results.size() * sizeof(Result)) == size
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+}
+
+/**
+ * @brief Запуск тестов для типа кеша в дочернем процессе и чтение
+ * результатов.
+ *
+ * @param type Тип кеша
+ * @param options Параметры запуска
+ * @param results Результаты
+ *
+ * @return Результат выполнения
+ */
+bool Spawn(const char *type, const Options &options, std::vector<Result> &results) noexcept
+{
+    int channel[2]{-1, -1};
+    if (pipe(channel) != 0)
+    {
+        std::perror("pipe");
+        return false;
+    }
+
+    std::fflush(nullptr);
+    const pid_t child = fork();
+    if (child < 0)
+    {
+        std::perror("fork");
+        close(channel[0]);
+        close(channel[1]);
+        return false;
+    }
+
+    if (child == 0)
+    {
+        close(channel[0]);
+        const int code = RunType(type, options, channel[1]);
+        std::fflush(nullptr);
+        _exit(code);
+    }
+
+    close(channel[1]);
+
+    Result result;
+    while (read(channel[0], &result, sizeof(result)) == sizeof(result))
+    {
+        results.push_back(result);
+    }
+    close(channel[0]);
+
+    int status{0};
+    waitpid(child, &status, 0);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+double Ratio(double value, double base) noexcept
+{
+    return base > 0 ? value / base : 0;
+}
+
+//------------------------------------------------------------------------------
+bool ParseOptions(int argc, char *argv[], Options &options) noexcept
+{
+    int option{0};
+    while ((option = getopt(argc, argv, "t:n:c:r:w:d:")) != -1)
+    {
+        switch (option)
+        {
+            case 't':
+                options.threads = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'n':
+                options.updates = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'c':
+                options.creates = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'r':
+                options.renews = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'w':
+                options.renew_wait = std::strtoll(optarg, nullptr, 10);
+                break;
+            case 'd':
+                options.directory = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (options.threads == 0)
+    {
+        options.threads = 1;
+    }
+
+    return true;
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr,
+                     "Использование: %s [-t потоков] [-n операций] [-c созданий] "
+                     "[-r продлений] [-w секунд] [-d каталог]\n",
+                     argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::printf("Системные вызовы: %s\n\n",
+                SyscallCounter::Tracepoint() >= 0
+                    ? "все (raw_syscalls:sys_enter)"
+                    : "только чтение и запись (/proc/thread-self/io)");
+
+    bool ok{true};
+    std::vector<Result> results;
+    for (const char *type : {"FILE", "MEMORY"})
+    {
+        ok = Spawn(type, options, results) && ok;
+    }
+
+    std::printf("%-7s %-10s %7s %10s %12s %12s %12s %10s %14s\n",
+                "cache", "test", "threads", "ops", "ns/op", "allocs/op",
+                "syscalls/op", "waits", "lock_wait_ns");
+    for (const auto &result : results)
+    {
+        ok = ok && result.ok;
+        std::printf("%-7s %-10s %7u %10llu %12.1f %12.2f %12.2f %10llu %14llu%s\n",
+                    result.type,
+                    result.test,
+                    result.threads,
+                    static_cast<unsigned long long>(result.ops),
+                    result.ns,
+                    result.allocs,
+                    result.syscalls,
+                    static_cast<unsigned long long>(result.flight_waits),
+                    static_cast<unsigned long long>(result.lock_wait_ns),
+                    result.ok ? "" : " (ошибки)");
+    }
+
+    std::printf("\nMEMORY / FILE:\n");
+    for (const auto &memory : results)
+    {
+        if (std::strcmp(memory.type, "MEMORY") != 0)
+        {
+            continue;
+        }
+
+        for (const auto &file : results)
+        {
+            if (std::strcmp(file.type, "FILE") == 0 && std::strcmp(file.test, memory.test) == 0)
+            {
+                std::printf("%-10s ns/op x%.2f, syscalls/op %.2f / %.2f\n",
+                            memory.test,
+                            Ratio(memory.ns, file.ns),
+                            memory.syscalls,
+                            file.syscalls);
+            }
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,369 @@
+/**
+ * @file
+ * @brief Проверка продления, повторного запроса билета и задержки после
+ * ошибок на библиотеке, собранной с TASP_KRB5_FAULT_INJECTION.
+ *
+ * Программа получает билет объекта Service::Instance() при имитации
+ * задержки и ошибок обмена с KDC (kerberos/fault/latency, kerberos/fault/every
+ * и kerberos/fault/error) и проверяет:
+ *
+ * - latency — обмен с KDC длится не меньше kerberos/fault/latency, время
+ *   отражает гистограмма kdc_latency;
+ * - backoff — ошибка обмена включает задержку повторных попыток
+ *   (Service::Health), пока она действует, обновление не обращается к KDC,
+ *   успешный обмен задержку сбрасывает;
+ * - refresh — по наступлении срока обновления билет продлевается или
+ *   запрашивается заново (счетчики renew_ok, reinit_ok), несмотря на
+ *   ошибки отдельных обменов;
+ * - overlap — создание кеша, вызванное во время обновления, не получает
+ *   результат обновления, а запрашивает новый билет у KDC.
+ *
+ * Для проверки refresh задаются короткие kerberos/ticket_lifetime и
+ * kerberos/renew_lifetime, чтобы срок обновления наступил за время
+ * ожидания. Код завершения отличен от 0, если хотя бы одна проверка не
+ * пройдена.
+ *
+ * Использование: tasp-krb5-fault [-w секунд]
+ */
+#include "tasp/config.hpp"
+#include "tasp/krb5.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+
+using CMC::configGlobal;
+using std::string;
+using tasp::krb5::ErrorCategory;
+using tasp::krb5::Service;
+using tasp::krb5::ServiceMetrics;
+using tasp::krb5::Status;
+using tasp::krb5::TicketState;
+
+namespace
+{
+/**
+ * @brief Параметры имитации отказов из конфигурации.
+ */
+struct FaultConfig
+{
+    long latency_ms{0}; /*!< Задержка обмена, мс */
+    long every{0};      /*!< Номер обмена, завершаемого ошибкой */
+};
+
+/**
+ * @brief Число непройденных проверок.
+ */
+int failed_checks{0};
+
+//------------------------------------------------------------------------------
+long ConfigInteger(const char *key, long default_value) noexcept
+{
+    const string text = configGlobal::instance().variable(key, "");
+    if (text.empty())
+    {
+        return default_value;
+    }
+
+    char *end{nullptr};
+    const long value = std::strtol(text.c_str(), &end, 10);
+    return end != nullptr && *end == '\0' ? value : default_value;
+}
+
+//------------------------------------------------------------------------------
+void Check(const char *stage, bool condition, const char *description) noexcept
+{
+    std::printf("[%s] %-6s %s\n", condition ? "OK" : "FAIL", stage, description);
+    if (!condition)
+    {
+        ++failed_checks;
+    }
+}
+
+//------------------------------------------------------------------------------
+void PrintStatus(const char *stage, const Status &status) noexcept
+{
+    std::printf("       %-6s код %d, категория %d\n",
+                stage,
+                status.code,
+                static_cast<int>(status.category));
+}
+
+/**
+ * @brief Получение билета с повторами при имитированных ошибках.
+ *
+ * Вызов CreateCcacheStatus() не учитывает задержку после ошибок, поэтому
+ * повтор выполняется сразу; при ошибке каждого every-го обмена успешный
+ * обмен наступает не позже чем через every попыток.
+ *
+ * @param fault Параметры имитации
+ * @param elapsed_ms Время успешной попытки, мс
+ *
+ * @return Результат последней попытки
+ */
+Status Create(const FaultConfig &fault, std::int64_t &elapsed_ms) noexcept
+{
+    const auto &service = Service::Instance();
+
+    Status status{};
+    for (long attempt = 0; attempt <= fault.every; ++attempt)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        status = service.CreateCcacheStatus();
+        elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+
+        if (status.Ok() || status.category != ErrorCategory::Transient)
+        {
+            break;
+        }
+    }
+
+    return status;
+}
+
+//------------------------------------------------------------------------------
+void CheckLatency(const FaultConfig &fault) noexcept
+{
+    const ServiceMetrics before = Service::Metrics();
+
+    std::int64_t elapsed_ms{0};
+    const Status status = Create(fault, elapsed_ms);
+    PrintStatus("latency", status);
+
+    const ServiceMetrics after = Service::Metrics();
+
+    Check("latency", status.Ok(), "билет получен");
+    Check("latency", elapsed_ms >= fault.latency_ms, "обмен не короче kerberos/fault/latency");
+    Check("latency",
+          after.kdc_latency.count > before.kdc_latency.count,
+          "обмен учтен в kdc_latency");
+    Check("latency", after.reinit_ok > before.reinit_ok, "учтен reinit_ok");
+}
+
+//------------------------------------------------------------------------------
+void CheckBackoff(const FaultConfig &fault) noexcept
+{
+    if (fault.every <= 0)
+    {
+        std::printf("[SKIP] backoff kerberos/fault/every не задан\n");
+        return;
+    }
+
+    const auto &service = Service::Instance();
+
+    // Ошибкой завершается каждый every-й обмен, поэтому одна из every
+    // попыток подряд завершается ошибкой.
+    Status status{};
+    for (long attempt = 0; attempt < fault.every && status.Ok(); ++attempt)
+    {
+        status = service.CreateCcacheStatus();
+    }
+    PrintStatus("backoff", status);
+
+    Check("backoff", !status.Ok(), "имитированная ошибка получена");
+    Check("backoff",
+          status.category == ErrorCategory::Transient,
+          "ошибка отнесена к временным");
+
+    const auto health = service.Health();
+    Check("backoff", health.backoff, "задержка повторных попыток включена");
+    Check("backoff", health.failures > 0, "ошибка учтена в failures");
+    Check("backoff", health.retry_in > 0, "время следующей попытки в будущем");
+    Check("backoff",
+          service.LastStatus().code == status.code,
+          "LastStatus() возвращает результат ошибки");
+
+    std::int64_t elapsed_ms{0};
+    const Status recovered = Create(fault, elapsed_ms);
+
+    const auto after = service.Health();
+    Check("backoff", recovered.Ok(), "билет получен после ошибки");
+    Check("backoff", !after.backoff && after.failures == 0, "задержка сброшена после успеха");
+}
+
+/**
+ * @brief Проверка отсутствия обмена с KDC при действующей задержке.
+ *
+ * @param failure Результат неуспешного обновления
+ */
+void CheckSuppressed(const Status &failure) noexcept
+{
+    const auto &service = Service::Instance();
+
+    const ServiceMetrics before = Service::Metrics();
+    const Status status = service.UpdateCcacheStatus();
+    const ServiceMetrics after = Service::Metrics();
+
+    Check("backoff",
+          after.update_backoff > before.update_backoff,
+          "обновление при задержке учтено в update_backoff");
+    Check("backoff",
+          after.kdc_latency.count == before.kdc_latency.count,
+          "обновление при задержке не обращается к KDC");
+    Check("backoff",
+          status.code == failure.code && status.category == failure.category,
+          "обновление при задержке возвращает последний результат");
+}
+
+/**
+ * @brief Проверка создания кеша во время обновления другим потоком.
+ *
+ * Обновление с наступившим сроком выполняется в отдельном потоке, через
+ * половину kerberos/fault/latency вызывается CreateCcacheStatus(). Создание
+ * не должно возвращать результат обновления: после его завершения
+ * выполняется собственный запрос нового билета (reinit_ok или
+ * reinit_failed). Обновление продлевает билет (renew_*), а при ошибке
+ * продления или невозможности продления запрашивает новый.
+ *
+ * @param fault Параметры имитации
+ *
+ * @return Результат обновления
+ */
+Status CheckOverlap(const FaultConfig &fault) noexcept
+{
+    const auto &service = Service::Instance();
+
+    if (fault.latency_ms < 100)
+    {
+        std::printf("[SKIP] overlap kerberos/fault/latency меньше 100 мс\n");
+        return service.UpdateCcacheStatus();
+    }
+
+    const ServiceMetrics before = Service::Metrics();
+
+    Status updated{};
+    std::thread update([&service, &updated]() noexcept { updated = service.UpdateCcacheStatus(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(fault.latency_ms / 2));
+    const Status created = service.CreateCcacheStatus();
+    update.join();
+
+    const ServiceMetrics after = Service::Metrics();
+    PrintStatus("overlap", created);
+
+    const auto renews = (after.renew_ok - before.renew_ok) +
+                        (after.renew_failed - before.renew_failed);
+    const auto reinits = (after.reinit_ok - before.reinit_ok) +
+                         (after.reinit_failed - before.reinit_failed);
+    const auto update_reinits =
+        renews == 0 ? 1 : after.renew_failed - before.renew_failed;
+
+    // Создание, вызванное во время обмена обновления, ожидает блокировку
+    // mutex_ до его завершения.
+    const auto waited_ns = after.lock_wait.sum_ns - before.lock_wait.sum_ns;
+    if (waited_ns < static_cast<std::uint64_t>(fault.latency_ms) * 1'000'000 / 4)
+    {
+        std::printf("[SKIP] overlap обновление завершилось до создания\n");
+        return updated;
+    }
+
+    Check("overlap",
+          reinits >= update_reinits + 1,
+          "создание во время обновления запрашивает новый билет у KDC");
+
+    return updated;
+}
+
+//------------------------------------------------------------------------------
+void CheckRefresh(const FaultConfig &fault, std::int64_t wait_s) noexcept
+{
+    if (wait_s <= 0)
+    {
+        std::printf("[SKIP] refresh время ожидания не задано\n");
+        return;
+    }
+
+    const auto &service = Service::Instance();
+    const ServiceMetrics before = Service::Metrics();
+    const auto deadline = std::time(nullptr) + wait_s;
+
+    bool due{false};
+    bool suppressed{false};
+    Status status{};
+    while (std::time(nullptr) < deadline)
+    {
+        if (service.Ticket().state == TicketState::None)
+        {
+            if (due)
+            {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+
+        status = due ? service.UpdateCcacheStatus() : CheckOverlap(fault);
+        due = true;
+        if (status.Ok())
+        {
+            continue;
+        }
+
+        PrintStatus("refresh", status);
+        if (!suppressed && service.Health().backoff)
+        {
+            CheckSuppressed(status);
+            suppressed = true;
+        }
+
+        const auto retry_in = std::max<std::int64_t>(service.Health().retry_in, 1);
+        std::this_thread::sleep_for(std::chrono::seconds(retry_in));
+    }
+
+    const ServiceMetrics after = Service::Metrics();
+    const auto renewed = after.renew_ok - before.renew_ok;
+    const auto reinited = after.reinit_ok - before.reinit_ok;
+    std::printf("       refresh продлений %llu, новых билетов %llu, ошибок %llu\n",
+                static_cast<unsigned long long>(renewed),
+                static_cast<unsigned long long>(reinited),
+                static_cast<unsigned long long>(
+                    (after.renew_failed - before.renew_failed) +
+                    (after.reinit_failed - before.reinit_failed)));
+
+    Check("refresh", due, "срок обновления билета наступил за время ожидания");
+    Check("refresh", renewed + reinited > 0, "билет продлен или получен заново");
+    Check("refresh",
+          service.Ticket().state == TicketState::None && service.Health().ready,
+          "после обновления билет действителен");
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::int64_t wait_s{600};
+
+    int option{0};
+    while ((option = getopt(argc, argv, "w:")) != -1)
+    {
+        if (option != 'w')
+        {
+            std::fprintf(stderr, "Использование: %s [-w секунд]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        wait_s = std::strtoll(optarg, nullptr, 10);
+    }
+
+    const FaultConfig fault{ConfigInteger("kerberos/fault/latency", 0),
+                            ConfigInteger("kerberos/fault/every", 0)};
+    std::printf("Имитация: задержка %ld мс, ошибка каждого %ld-го обмена\n",
+                fault.latency_ms,
+                fault.every);
+
+    CheckLatency(fault);
+    CheckBackoff(fault);
+    CheckRefresh(fault, wait_s);
+
+    std::printf("Не пройдено проверок: %d\n", failed_checks);
+    return failed_checks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}